@@ -0,0 +1,128 @@
+#ifndef BRENT_H_
+#define BRENT_H_
+
+// Constant-memory cycle detection on GLife trajectories.
+
+#include <optional>
+
+#include "entropy.h"
+#include "glife.h"
+#include "hashlife.h"
+
+struct CycleInfo {
+  // Index of the first state on the cycle.
+  int transient = 0;
+  int cycle_len = 0;
+};
+
+// Follow the trajectory starting at the current state of 'glife' with
+// Brent's algorithm, comparing state fingerprints and confirming
+// matches exactly. Memory is O(vertices) regardless of the trajectory.
+//
+// Returns the cycle if its first repeated state, at index
+// transient + cycle_len, comes before 'max_steps'; this is the same
+// condition under which a table of all visited states would find it.
+// On success 'glife' is left at the first state of the cycle; otherwise
+// its state is unspecified.
+//
+// Such a cycle has its transient before state max_steps - 1, so that
+// state is on it. Once the hare gets there without a match, the
+// tortoise moves there and the hare gets max_steps more states to come
+// back; the hare therefore stops within 2 * max_steps states.
+//
+// If 'prefix' is given, states [0, max_steps) are added to it as the
+// hare passes them. That covers all of them whenever no cycle is
+// returned, so a caller can then take the entropy without a replay.
+inline std::optional<CycleInfo> FindCycleBrent(
+    GLife& glife, int max_steps, EntropyAccumulator* prefix = nullptr) {
+  const GLife::State start = glife.GetState();
+  if (prefix != nullptr && max_steps > 0) prefix->Add(start);
+  if (max_steps < 2) return std::nullopt;
+
+  // Find the cycle length. The tortoise sits at state 2^k - 1 while the
+  // hare explores the next 2^k states, until the hare reaches state
+  // 'last' (see above).
+  const long last = max_steps - 1;
+  GLife::State tortoise = start;
+  uint64_t tortoise_fp = glife.Fingerprint();
+  long power = 1;
+  int lambda = 1;
+  long hare_steps = 1;
+  glife.Update();
+  while (true) {
+    if (prefix != nullptr && hare_steps < max_steps) {
+      prefix->Add(glife.GetState());
+    }
+    if (glife.Fingerprint() == tortoise_fp && glife.GetState() == tortoise) {
+      break;
+    }
+    if (hare_steps == last || power == lambda) {
+      if (hare_steps > last) return std::nullopt;
+      tortoise = glife.GetState();
+      tortoise_fp = glife.Fingerprint();
+      power = hare_steps == last ? max_steps : 2 * power;
+      lambda = 0;
+    }
+    glife.Update();
+    hare_steps += 1;
+    lambda += 1;
+  }
+  if (lambda >= max_steps) return std::nullopt;
+
+  // Find the transient: start the hare 'lambda' states ahead of the
+  // tortoise and advance both until they meet.
+  glife.SetState(start);
+  GLife hare(glife);
+  for (int i = 0; i < lambda; ++i) hare.Update();
+  int mu = 0;
+  while (glife.Fingerprint() != hare.Fingerprint() ||
+         glife.GetState() != hare.GetState()) {
+    if (mu + lambda >= max_steps) return std::nullopt;
+    glife.Update();
+    hare.Update();
+    mu += 1;
+  }
+  if (mu + lambda >= max_steps) return std::nullopt;
+  return CycleInfo{mu, lambda};
+}
+
+// FindCycleBrent() on a Hashlife trajectory from 'start'. Equal states
+// are the same node, so comparisons are exact and O(1), and the hare
+// jumps ahead by the cycle length in one Advance().
+inline std::optional<CycleInfo> FindCycleHashlife(Hashlife& hashlife,
+                                                  Hashlife::Node start,
+                                                  int max_steps) {
+  if (max_steps < 2) return std::nullopt;
+  const long last = max_steps - 1;
+  Hashlife::Node tortoise = start;
+  Hashlife::Node hare = hashlife.Step(start, 0);
+  long power = 1;
+  int lambda = 1;
+  long hare_steps = 1;
+  while (hare != tortoise) {
+    if (hare_steps == last || power == lambda) {
+      if (hare_steps > last) return std::nullopt;
+      tortoise = hare;
+      power = hare_steps == last ? max_steps : 2 * power;
+      lambda = 0;
+    }
+    hare = hashlife.Step(hare, 0);
+    hare_steps += 1;
+    lambda += 1;
+  }
+  if (lambda >= max_steps) return std::nullopt;
+
+  tortoise = start;
+  hare = hashlife.Advance(start, lambda);
+  int mu = 0;
+  while (tortoise != hare) {
+    if (mu + lambda >= max_steps) return std::nullopt;
+    tortoise = hashlife.Step(tortoise, 0);
+    hare = hashlife.Step(hare, 0);
+    mu += 1;
+  }
+  if (mu + lambda >= max_steps) return std::nullopt;
+  return CycleInfo{mu, lambda};
+}
+
+#endif  // BRENT_H_
@@ -0,0 +1,246 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+// Crash-safe progress of a long shannon2 run: each finished SimResult
+// is appended to a log in the output directory, which is synced to disk
+// every few seconds, so a run that is killed can be resumed and skip the
+// states already done.
+//
+// Layout:
+//   CheckpointHeader
+//   records, each:
+//     int32   index            slot in the results of the run
+//     int32   max_steps
+//     int32   cycle_len
+//     int32   num_live_size
+//     uint64  entropy          the bits of the double, so it is exact
+//     int32   num_live[num_live_size]
+//     uint64  checksum         FNV-1a of the record up to here
+//
+// A crash can leave a partial record at the end; Open() drops it. All
+// integers are in host byte order, as in gbinary.h.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "profile.h"
+#include "simulate.h"
+
+struct CheckpointHeader {
+  static constexpr char kMagic[8] = {'G', 'L', 'I', 'F', 'E', 'C', 'K', '2'};
+
+  char magic[8];
+  uint32_t header_size;
+  int32_t max_steps;
+  // Results of the run, and the states file and shard they come from.
+  int64_t num_results;
+  int64_t num_states;
+  int32_t shard_index;
+  int32_t shard_count;
+  // Hash of everything else the results depend on: the rule, the graph
+  // and its edits, and the states, as computed by the driver.
+  uint64_t run_id;
+};
+
+class CheckpointLog {
+ public:
+  // Sync at most every 'interval_secs' seconds.
+  explicit CheckpointLog(double interval_secs)
+      : interval_(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(interval_secs))) {}
+
+  ~CheckpointLog() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  CheckpointLog(const CheckpointLog&) = delete;
+  CheckpointLog& operator=(const CheckpointLog&) = delete;
+
+  // Start the log 'filename' for the run 'run' (its magic and size are
+  // filled in here). With 'resume', an existing log of the same run is
+  // continued instead: the results it holds are stored into 'results'
+  // and flagged in 'done'. Returns false with a message in 'error' if the
+  // file cannot be written or is the log of another run.
+  bool Open(const std::string& filename, CheckpointHeader run, bool resume,
+            std::vector<SimResult>* results, std::vector<char>* done,
+            std::string* error) {
+    memcpy(run.magic, CheckpointHeader::kMagic, sizeof(run.magic));
+    run.header_size = sizeof(run);
+    done->assign(results->size(), 0);
+    fd_ = open(filename.c_str(), O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC),
+               0666);
+    if (fd_ < 0) {
+      *error = filename + ": " + strerror(errno);
+      return false;
+    }
+    std::string log;
+    if (!ReadAll(&log)) {
+      *error = filename + ": " + strerror(errno);
+      return false;
+    }
+    off_t end = 0;
+    if (log.size() >= sizeof(run)) {
+      CheckpointHeader h;
+      memcpy(&h, log.data(), sizeof(h));
+      if (memcmp(&h, &run, sizeof(h)) != 0) {
+        *error = filename + " is the checkpoint of another run";
+        return false;
+      }
+      end = Replay(log, results, done);
+    }
+    // Drop a partial record, or an incomplete header, left by a crash.
+    if (ftruncate(fd_, end) != 0 || lseek(fd_, end, SEEK_SET) != end) {
+      *error = filename + ": " + strerror(errno);
+      return false;
+    }
+    if (end == 0) {
+      buffer_.assign(reinterpret_cast<const char*>(&run), sizeof(run));
+      if (!Flush()) {
+        *error = filename + ": " + strerror(errno);
+        return false;
+      }
+      // Make the new file itself durable.
+      const std::string dir = filename.substr(0, filename.rfind('/') + 1);
+      const int dir_fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+      if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+      }
+    }
+    last_sync_ = Clock::now();
+    return true;
+  }
+
+  // Record result 'index'; safe to call from any thread. Appends to a
+  // buffer, which goes to disk once the interval has passed.
+  void Add(int index, const SimResult& result) {
+    GLIFE_PROFILE_SCOPE(kCheckpoint);
+    std::lock_guard<std::mutex> lock(mu_);
+    if (fd_ < 0) return;
+    const size_t start = buffer_.size();
+    Append<int32_t>(index);
+    Append<int32_t>(result.max_steps);
+    Append<int32_t>(result.cycle_len);
+    Append<int32_t>(result.num_live.size());
+    uint64_t entropy;
+    memcpy(&entropy, &result.entropy, sizeof(entropy));
+    Append<uint64_t>(entropy);
+    for (int n : result.num_live) Append<int32_t>(n);
+    Append<uint64_t>(Checksum(buffer_.data() + start, buffer_.size() - start));
+    if (Clock::now() - last_sync_ >= interval_) Sync();
+  }
+
+  // Write out and sync what is buffered. Returns false if any write
+  // failed.
+  bool Close() {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (fd_ >= 0) Sync();
+    return !failed_;
+  }
+
+  // FNV-1a of 'size' bytes at 'data'.
+  static uint64_t Checksum(const char* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+      h = (h ^ uint8_t(data[i])) * 0x100000001b3ULL;
+    }
+    return h;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  const Clock::duration interval_;
+  std::mutex mu_;
+  int fd_ = -1;
+  std::string buffer_;
+  Clock::time_point last_sync_;
+  bool failed_ = false;
+
+  template <typename T>
+  void Append(T value) {
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  bool ReadAll(std::string* contents) {
+    char chunk[1 << 16];
+    while (true) {
+      const ssize_t n = read(fd_, chunk, sizeof(chunk));
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return false;
+      if (n == 0) return true;
+      contents->append(chunk, n);
+    }
+  }
+
+  // Store the complete records of 'log' into 'results'. Returns the end
+  // of the last one.
+  off_t Replay(const std::string& log, std::vector<SimResult>* results,
+               std::vector<char>* done) const {
+    size_t pos = sizeof(CheckpointHeader);
+    while (true) {
+      int32_t fixed[4];
+      uint64_t entropy, checksum;
+      if (log.size() - pos < sizeof(fixed) + 2 * sizeof(uint64_t)) break;
+      memcpy(fixed, log.data() + pos, sizeof(fixed));
+      const int32_t index = fixed[0];
+      const int32_t num_live_size = fixed[3];
+      if (index < 0 || index >= results->size() || num_live_size < 0 ||
+          (log.size() - pos - sizeof(fixed) - 2 * sizeof(uint64_t)) / 4 <
+              size_t(num_live_size)) {
+        break;
+      }
+      const size_t size =
+          sizeof(fixed) + sizeof(entropy) + 4 * size_t(num_live_size);
+      memcpy(&checksum, log.data() + pos + size, sizeof(checksum));
+      if (checksum != Checksum(log.data() + pos, size)) break;
+      SimResult& result = (*results)[index];
+      result.max_steps = fixed[1];
+      result.cycle_len = fixed[2];
+      memcpy(&entropy, log.data() + pos + sizeof(fixed), sizeof(entropy));
+      memcpy(&result.entropy, &entropy, sizeof(entropy));
+      result.num_live.resize(num_live_size);
+      memcpy(result.num_live.data(),
+             log.data() + pos + sizeof(fixed) + sizeof(entropy),
+             4 * size_t(num_live_size));
+      (*done)[index] = 1;
+      pos += size + sizeof(checksum);
+    }
+    return pos;
+  }
+
+  // Write the whole buffer. False on errors.
+  bool Flush() {
+    size_t pos = 0;
+    while (pos < buffer_.size()) {
+      const ssize_t n = write(fd_, buffer_.data() + pos, buffer_.size() - pos);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return false;
+      pos += n;
+    }
+    buffer_.clear();
+    return fdatasync(fd_) == 0;
+  }
+
+  // Flush(), and on failure stop checkpointing: the run itself goes on.
+  void Sync() {
+    if (!Flush()) {
+      fprintf(stderr, "Checkpoint write failed: %s\n", strerror(errno));
+      failed_ = true;
+      close(fd_);
+      fd_ = -1;
+    }
+    last_sync_ = Clock::now();
+  }
+};
+
+#endif  // CHECKPOINT_H_
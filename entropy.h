@@ -0,0 +1,139 @@
+#ifndef ENTROPY_H_
+#define ENTROPY_H_
+
+// Shannon entropy of vertex states along a trajectory.
+
+#include <assert.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "glife.h"
+#include "work_pool.h"
+
+// Average per-vertex entropy, given how many of 'num_states' states
+// each vertex was live in.
+inline double EntropyFromCounts(const std::vector<int>& v, int num_states) {
+  const size_t num_nodes = v.size();
+  double result = 0.0;
+  for (const auto count : v) {
+    assert(count <= num_states);
+    double p1 = (double)count / num_states;
+    assert(p1 <= 1.0);
+    assert(0.0 <= p1);
+    double p0 = 1.0 - p1;
+    assert(p0 <= 1.0);
+    assert(0.0 <= p0);
+
+    if (p0 != 0) { result -= p0 * std::log2(p0); }
+    if (p1 != 0) { result -= p1 * std::log2(p1); }
+  }
+  return result / num_nodes;
+}
+
+// Entropy of a sequence of states given as '1'/'.' strings.
+inline double ShannonEntropy(std::vector<std::string>::iterator begin,
+                             std::vector<std::string>::iterator end) {
+  assert(begin != end);
+
+  const size_t num_nodes = begin->size();
+  std::vector<int> v(num_nodes);
+  for (auto it = begin; it != end; ++it) {
+    assert(it->size() == num_nodes);
+    for (int j = 0; j < num_nodes; j++) {
+      v[j] += (*it)[j] == '1' ? 1 : 0;
+    }
+  }
+  return EntropyFromCounts(v, end - begin);
+}
+
+// Streaming entropy: states are added one at a time as a simulation
+// produces them, and only a live count per vertex is kept.
+//
+// Checkpoint() marks the start of a window; EntropySinceCheckpoint()
+// then covers exactly the states added after it, e.g. one pass around
+// a cycle once its bounds are known.
+class EntropyAccumulator {
+ public:
+  // With a 'team', Add() splits each state's words over its threads.
+  explicit EntropyAccumulator(int num_vertices, ParallelTeam* team = nullptr)
+      : counts_(num_vertices), checkpoint_counts_(num_vertices), team_(team) {}
+
+  // For the states of 'glife', split over its update threads. The
+  // entropy is summed in the numbering of the graph as loaded, so that
+  // it does not depend on Reorder().
+  explicit EntropyAccumulator(const GLife& glife)
+      : EntropyAccumulator(glife.NumVertices(), glife.Team()) {
+    original_ = glife.Topology()->OriginalIndex();
+  }
+
+  void Add(const GLife::State& state) {
+    GLIFE_PROFILE_SCOPE(kEntropy);
+    if (team_ == nullptr) {
+      AddWords(state, 0, state.size());
+    } else {
+      team_->Run([&](int part) {
+        const auto [begin, end] = team_->Range(state.size(), part);
+        AddWords(state, begin, end);
+      });
+    }
+    num_states_ += 1;
+  }
+
+  // Add a state given by its live vertices.
+  void AddLive(const std::vector<int>& live) {
+    GLIFE_PROFILE_SCOPE(kEntropy);
+    for (int v : live) counts_[v] += 1;
+    num_states_ += 1;
+  }
+
+  int num_states() const { return num_states_; }
+
+  // Entropy over all states added so far.
+  double Entropy() const {
+    return EntropyFromCounts(InOriginalOrder(counts_), num_states_);
+  }
+
+  void Checkpoint() {
+    checkpoint_counts_ = counts_;
+    checkpoint_states_ = num_states_;
+  }
+
+  // Entropy over the states added since the last Checkpoint().
+  double EntropySinceCheckpoint() const {
+    std::vector<int> v(counts_.size());
+    for (int j = 0; j < v.size(); j++) {
+      v[j] = counts_[j] - checkpoint_counts_[j];
+    }
+    return EntropyFromCounts(InOriginalOrder(v),
+                             num_states_ - checkpoint_states_);
+  }
+
+ private:
+  // Number of added states in which each vertex was live.
+  std::vector<int> counts_;
+  int num_states_ = 0;
+  std::vector<int> checkpoint_counts_;
+  int checkpoint_states_ = 0;
+  ParallelTeam* const team_;
+  // See GTopology::OriginalIndex().
+  std::vector<int> original_;
+
+  std::vector<int> InOriginalOrder(const std::vector<int>& v) const {
+    if (original_.empty()) return v;
+    std::vector<int> result(v.size());
+    for (int j = 0; j < v.size(); j++) result[original_[j]] = v[j];
+    return result;
+  }
+
+  // Each thread owns the counts of its own words.
+  void AddWords(const GLife::State& state, size_t begin, size_t end) {
+    for (size_t w = begin; w < end; w++) {
+      for (uint64_t bits = state[w]; bits != 0; bits &= bits - 1) {
+        counts_[64 * w + __builtin_ctzll(bits)] += 1;
+      }
+    }
+  }
+};
+
+#endif  // ENTROPY_H_
@@ -0,0 +1,118 @@
+#ifndef GBINARY_H_
+#define GBINARY_H_
+
+// Binary graph file format, read through mmap.
+//
+// Layout, each section starting on an 8-byte boundary:
+//   GraphFileHeader
+//   int32   offsets[num_vertices + 1]     CSR row starts
+//   int32   neighbors[num_neighbors]      CSR rows, sorted
+//   int64   name_offsets[num_vertices + 1]
+//   char    names[names_size]             vertex names, back to back
+//   uint64  state[(num_vertices + 63) / 64]   initial live vertices
+//
+// All integers are in host byte order; a file is only meant to be read
+// on the kind of machine that wrote it.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+struct GraphFileHeader {
+  static constexpr char kMagic[8] = {'G', 'L', 'I', 'F', 'E', 'G', 'R', '1'};
+
+  char magic[8];
+  uint32_t header_size;
+  // Size of the GTorus this graph is, or 0.
+  int32_t torus_size;
+  int64_t num_vertices;
+  int64_t num_neighbors;
+  int64_t names_size;
+  // Size and modification time of the file this was converted from, or
+  // 0 when written directly.
+  int64_t source_size;
+  int64_t source_mtime_ns;
+};
+
+// Byte offsets of the sections of a graph file.
+struct GraphFileLayout {
+  explicit GraphFileLayout(const GraphFileHeader& h) {
+    offsets = Align(sizeof(GraphFileHeader));
+    neighbors = Align(offsets + 4 * (h.num_vertices + 1));
+    name_offsets = Align(neighbors + 4 * h.num_neighbors);
+    names = name_offsets + 8 * (h.num_vertices + 1);
+    state = Align(names + h.names_size);
+    size = state + 8 * ((h.num_vertices + 63) / 64);
+  }
+
+  static int64_t Align(int64_t pos) { return (pos + 7) & ~int64_t{7}; }
+
+  int64_t offsets;
+  int64_t neighbors;
+  int64_t name_offsets;
+  int64_t names;
+  int64_t state;
+  int64_t size;
+};
+
+// Size and modification time of 'filename', identifying one version of
+// it. Returns false if it cannot be stat()ed.
+inline bool GraphSourceId(const std::string& filename, int64_t* size,
+                          int64_t* mtime_ns) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  *size = st.st_size;
+  *mtime_ns = int64_t{st.st_mtim.tv_sec} * 1000000000 + st.st_mtim.tv_nsec;
+  return true;
+}
+
+// A read-only, shared mapping of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) {
+        data_ = static_cast<const char*>(p);
+        size_ = st.st_size;
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool ok() const { return data_ != nullptr; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// True if 'filename' starts like a graph file.
+inline bool IsGraphFile(const std::string& filename) {
+  char magic[sizeof(GraphFileHeader::kMagic)];
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  const bool ok = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                  memcmp(magic, GraphFileHeader::kMagic, sizeof(magic)) == 0;
+  close(fd);
+  return ok;
+}
+
+#endif  // GBINARY_H_
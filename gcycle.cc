@@ -3,37 +3,9 @@
 #include <cmath>
 #include <map>
 
+#include "entropy.h"
 #include "glife.h"
 
-double ShannonEntropy(std::vector<std::string>::iterator begin,
-                      std::vector<std::string>::iterator end) {
-  assert(begin != end);
-
-  const size_t num_nodes = begin->size();
-  std::vector<int> v(num_nodes);
-  for (auto it = begin; it != end; ++it) {
-    assert(it->size() == num_nodes);
-    for (int j = 0; j < num_nodes; j++) {
-      v[j] += (*it)[j] == '1' ? 1 : 0;
-    }
-  }
-  double result = 0.0;
-  const int cycle_len = end - begin;
-  for (const auto count : v) {
-    assert(count <= cycle_len);
-    double p1 = (double)count / cycle_len;
-    assert(p1 <= 1.0);
-    assert(0.0 <= p1);
-    double p0 = 1.0 - p1;
-    assert(p0 <= 1.0);
-    assert(0.0 <= p0);
-
-    if (p0 != 0) { result -= p0 * std::log2(p0); }
-    if (p1 != 0) { result -= p1 * std::log2(p1); }
-  }
-  return result / num_nodes;
-}
-
 // Save all states to json file
 void SaveStates(std::string& filename,
                 const std::vector<std::string>& states) {
@@ -1,51 +1,75 @@
 // Generate N unique initial states for MxM torus with %p live cells
 //
-// Usage: ./genstates N M p
+// Usage: ./genstates [--seed=S] N M p [packed-file]
 //
+// Each state has exactly ceil(p * M * M) live cells, and the same seed
+// always gives the same states. States are printed one per line, or
+// written to 'packed-file' in the packed format of states_file.h.
 
 #include <iostream>
 #include <cmath>
-#include <set>
 #include <string>
-#include <time.h>
-#include <unistd.h>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "state_gen.h"
+#include "states_file.h"
+
+ABSL_FLAG(uint64_t, seed, 1, "Random seed");
+ABSL_FLAG(int, num_threads, std::thread::hardware_concurrency(),
+          "Number of threads to use");
 
 void usage(const char *argv0)
 {
-  std::cerr << "Usage: " << argv0 << " num-states torus-size fraction-live" << std::endl;
+  std::cerr << "Usage: " << argv0 << " num-states torus-size fraction-live"
+            << " [packed-file]" << std::endl;
   exit(1);
 }
 
-std::string gen_state(int size, double p)
-{
-  std::string state(size, '0');
-  int to_go = std::ceil(p * size);
-  while (to_go > 0) {
-    for (int j = 0; j < size && to_go > 0; j++) {
-      const double a = (double)rand() / RAND_MAX;
-      if (a < p && state[j] == '0') {
-        state[j] = '1';
-        to_go -= 1;
-      }
-    }
-  }
-  return state;
-}
-
 int main(int argc, char *argv[])
 {
-  srand(time(NULL));
-  std::set<std::string> states;
+  const auto args = absl::ParseCommandLine(argc, argv);
+  if (args.size() < 4) usage(argv[0]);
+  int N = atoi(args[1]);
+  int M = atoi(args[2]);
+  double p = atof(args[3]);
+  const int size = M * M;
+  const int num_live = std::min<int>(size, std::ceil(p * size));
+  if (N < 0 || M < 0 || p < 0) usage(argv[0]);
 
-  if (argc < 4) usage(argv[0]);
-  int N = atoi(argv[1]);
-  int M = atoi(argv[2]);
-  double p = atof(argv[3]);
+  const StateGenerator generator(size, num_live, absl::GetFlag(FLAGS_seed));
+  if (!generator.Enough(N)) {
+    std::cerr << "There are fewer than " << N << " states with " << num_live
+              << " of " << size << " cells live" << std::endl;
+    return 1;
+  }
+  const auto generated = generator.Generate(
+      N, std::max(1, absl::GetFlag(FLAGS_num_threads)));
+  if (!generated) {
+    std::cerr << "Could not generate " << N << " distinct states" << std::endl;
+    return 1;
+  }
+  const std::vector<uint64_t>& states = *generated;
+  const int words = generator.words_per_state();
 
-  while (states.size() < N) {
-    states.insert(gen_state(M * M, p));
+  if (args.size() > 4) {
+    StatesFileWriter writer(args[4], size);
+    for (int i = 0; i < N; i++) {
+      writer.Add(&states[int64_t(i) * words]);
+    }
+    if (!writer.Close()) {
+      std::cerr << "Error: could not write " << args[4] << std::endl;
+      return 1;
+    }
+    return 0;
   }
-  for (auto& s : states) {
-    std::cout << s << std::endl;
+  std::string s(size, '0');
+  for (int i = 0; i < N; i++) {
+    const uint64_t* row = &states[int64_t(i) * words];
+    for (int j = 0; j < size; j++) {
+      s[j] = (row[j >> 6] >> (j & 63)) & 1 ? '1' : '0';
+    }
+    std::cout << s << '\n';
   }
 }
@@ -0,0 +1,114 @@
+// Graph generator
+// Builds a torus, random regular or Watts-Strogatz graph and writes it
+// as JSON or in the binary graph format.
+//
+// Usage: ./ggen --type=torus --width=1000 out.json
+//        ./ggen --type=regular --num_vertices=1000000 --degree=8 out.bin
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "ggen.h"
+#include "glife.h"
+
+ABSL_FLAG(std::string, type, "torus",
+          "Graph to generate: torus, regular or watts_strogatz");
+ABSL_FLAG(int, width, 30, "Torus width");
+ABSL_FLAG(int, height, 0, "Torus height; 0 for a square torus");
+ABSL_FLAG(std::string, neighborhood, "moore",
+          "Torus neighborhood: moore or von_neumann");
+ABSL_FLAG(int, num_vertices, 1000, "Vertices of a regular or small world graph");
+ABSL_FLAG(int, degree, 8, "Degree of a regular or small world graph");
+ABSL_FLAG(double, beta, 0.1, "Rewiring probability of a small world graph");
+ABSL_FLAG(uint64_t, seed, 1, "Random seed");
+ABSL_FLAG(int, num_threads, std::thread::hardware_concurrency(),
+          "Number of threads to use");
+ABSL_FLAG(bool, binary, false,
+          "Write the binary graph format rather than JSON");
+ABSL_FLAG(bool, compact_json, false, "Write each edge once");
+ABSL_FLAG(bool, verbose, false, "Be verbose");
+
+void usage(const char *argv0)
+{
+  std::cerr << "Usage: " << argv0 << " [flags] output-file" << std::endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  const auto args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 2) usage(argv[0]);
+  const std::string filename = args[1];
+
+  const std::string type = absl::GetFlag(FLAGS_type);
+  const int num_threads = std::max(1, absl::GetFlag(FLAGS_num_threads));
+  const int degree = absl::GetFlag(FLAGS_degree);
+  const int num_vertices = absl::GetFlag(FLAGS_num_vertices);
+  const auto start = std::chrono::steady_clock::now();
+  CSRGraph graph;
+  if (type == "torus") {
+    const std::string neighborhood = absl::GetFlag(FLAGS_neighborhood);
+    if (neighborhood != "moore" && neighborhood != "von_neumann") {
+      std::cerr << "Unknown neighborhood " << neighborhood << std::endl;
+      exit(1);
+    }
+    const int width = absl::GetFlag(FLAGS_width);
+    const int height = absl::GetFlag(FLAGS_height) > 0
+                           ? absl::GetFlag(FLAGS_height) : width;
+    if (width <= 0) usage(argv[0]);
+    graph = GenerateTorus(width, height,
+                          neighborhood == "moore" ? Neighborhood::kMoore
+                                                  : Neighborhood::kVonNeumann,
+                          num_threads);
+  } else if (type == "regular") {
+    if (degree < 0 || degree >= num_vertices ||
+        (int64_t(num_vertices) * degree) % 2 != 0) {
+      std::cerr << "Need 0 <= degree < num_vertices, and an even "
+                << "num_vertices * degree" << std::endl;
+      exit(1);
+    }
+    auto regular = GenerateRandomRegular(num_vertices, degree,
+                                         absl::GetFlag(FLAGS_seed),
+                                         num_threads);
+    if (!regular) {
+      std::cerr << "Found no " << degree << "-regular graph on "
+                << num_vertices << " vertices; try another --seed"
+                << std::endl;
+      exit(1);
+    }
+    graph = std::move(*regular);
+  } else if (type == "watts_strogatz") {
+    if (degree < 0 || degree >= num_vertices || degree % 2 != 0) {
+      std::cerr << "Need an even degree below num_vertices" << std::endl;
+      exit(1);
+    }
+    graph = GenerateWattsStrogatz(num_vertices, degree,
+                                  absl::GetFlag(FLAGS_beta),
+                                  absl::GetFlag(FLAGS_seed), num_threads);
+  } else {
+    std::cerr << "Unknown graph type " << type << std::endl;
+    exit(1);
+  }
+  if (absl::GetFlag(FLAGS_verbose)) {
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Generated " << graph.NumVertices() << " vertices, "
+              << graph.neighbors.size() / 2 << " edges in " << elapsed.count()
+              << "s" << std::endl;
+  }
+
+  const GLife glife(std::move(graph));
+  if (absl::GetFlag(FLAGS_binary)) {
+    if (!glife.SaveBinary(filename)) {
+      std::cerr << "Error: could not write " << filename << std::endl;
+      return 1;
+    }
+  } else {
+    glife.DumpToJSON(filename, absl::GetFlag(FLAGS_compact_json));
+  }
+  return 0;
+}
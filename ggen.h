@@ -0,0 +1,428 @@
+#ifndef GGEN_H_
+#define GGEN_H_
+
+// Graph generators that build the CSR adjacency GLife uses directly,
+// without the per-vertex sets and name maps of GTorus or a JSON round
+// trip. Vertex rows are filled by several threads at once, and the
+// result depends only on the parameters and seed, not on num_threads.
+//
+//   GLife glife(GenerateTorus(1000, 1000, Neighborhood::kMoore, 8));
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rng.h"
+
+// A graph in compressed sparse row form: the neighbors of vertex i are
+// neighbors[offsets[i]] through neighbors[offsets[i + 1] - 1], sorted.
+struct CSRGraph {
+  std::vector<int> offsets = {0};
+  std::vector<int> neighbors;
+  std::vector<std::string> names;
+  // n when the graph is the n x n torus GTorus generates, else 0.
+  int torus_size = 0;
+
+  int NumVertices() const { return offsets.size() - 1; }
+};
+
+// Call fn(begin, end) on 'num_threads' contiguous slices of [0, n).
+inline void ParallelFor(int64_t n, int num_threads,
+                        const std::function<void(int64_t, int64_t)>& fn) {
+  num_threads = std::max<int64_t>(1, std::min<int64_t>(num_threads, n));
+  if (num_threads == 1) {
+    fn(0, n);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back(fn, n * t / num_threads, n * (t + 1) / num_threads);
+  }
+  for (auto& t : threads) t.join();
+}
+
+enum class Neighborhood {
+  // The 8 surrounding cells.
+  kMoore,
+  // The 4 orthogonally adjacent cells.
+  kVonNeumann,
+};
+
+// Name vertices by their index.
+inline void NameByIndex(CSRGraph* g, int num_threads) {
+  g->names.resize(g->NumVertices());
+  ParallelFor(g->NumVertices(), num_threads, [g](int64_t b, int64_t e) {
+    for (int64_t v = b; v < e; ++v) g->names[v] = std::to_string(v);
+  });
+}
+
+// Turn rows of 'degree' slots each, possibly with duplicates, into a
+// CSR graph with sorted rows. 'slots' is reused for the neighbors.
+inline void RowsToCSR(int num_vertices, int degree, std::vector<int> slots,
+                      int num_threads, CSRGraph* g) {
+  g->offsets.assign(num_vertices + 1, 0);
+  ParallelFor(num_vertices, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t v = b; v < e; ++v) {
+      int* row = &slots[v * degree];
+      std::sort(row, row + degree);
+      g->offsets[v + 1] = std::unique(row, row + degree) - row;
+    }
+  });
+  bool compact = true;
+  for (int v = 0; v < num_vertices; ++v) {
+    compact = compact && g->offsets[v + 1] == degree;
+    g->offsets[v + 1] += g->offsets[v];
+  }
+  if (!compact) {
+    // Rows only ever shrink, so moving them down in order is safe.
+    for (int v = 0; v < num_vertices; ++v) {
+      std::copy(slots.begin() + int64_t(v) * degree,
+                slots.begin() + int64_t(v) * degree +
+                    (g->offsets[v + 1] - g->offsets[v]),
+                slots.begin() + g->offsets[v]);
+    }
+    slots.resize(g->offsets[num_vertices]);
+  }
+  g->neighbors = std::move(slots);
+}
+
+// An n wide, m high torus. Cell (i, j) is vertex i + n * j, named
+// "i_j", as in GTorus.
+inline CSRGraph GenerateTorus(int n, int m, Neighborhood neighborhood,
+                              int num_threads) {
+  assert(n > 0 && m > 0);
+  static const int kSteps[8][2] = {{0, 1},  {0, -1}, {1, 0},  {-1, 0},
+                                   {1, 1},  {-1, -1}, {1, -1}, {-1, 1}};
+  const int degree = neighborhood == Neighborhood::kMoore ? 8 : 4;
+  const int num_vertices = n * m;
+  assert(int64_t(num_vertices) * degree <= INT_MAX);
+
+  CSRGraph g;
+  std::vector<int> slots(int64_t(num_vertices) * degree);
+  g.names.resize(num_vertices);
+  ParallelFor(m, num_threads, [&](int64_t b, int64_t e) {
+    for (int j = b; j < e; ++j) {
+      for (int i = 0; i < n; ++i) {
+        const int index = i + n * j;
+        for (int k = 0; k < degree; ++k) {
+          slots[int64_t(index) * degree + k] =
+              (i + kSteps[k][0] + n) % n + n * ((j + kSteps[k][1] + m) % m);
+        }
+        g.names[index] = std::to_string(i) + "_" + std::to_string(j);
+      }
+    }
+  });
+  // Tori narrower than 3 reach some cells twice.
+  RowsToCSR(num_vertices, degree, std::move(slots), num_threads, &g);
+  if (neighborhood == Neighborhood::kMoore && n == m && n >= 3) {
+    g.torus_size = n;
+  }
+  return g;
+}
+
+// The complement of the simple graph 'g': each vertex is joined to
+// exactly the other vertices it was not joined to. Vertices are named by
+// index.
+inline CSRGraph Complement(const CSRGraph& g, int num_threads) {
+  const int num_vertices = g.NumVertices();
+  CSRGraph c;
+  int64_t size = 0;
+  c.offsets.assign(num_vertices + 1, 0);
+  for (int v = 0; v < num_vertices; ++v) {
+    size += num_vertices - 1 - (g.offsets[v + 1] - g.offsets[v]);
+    assert(size <= INT_MAX);
+    c.offsets[v + 1] = size;
+  }
+  c.neighbors.resize(size);
+  ParallelFor(num_vertices, num_threads, [&](int64_t b, int64_t e) {
+    for (int v = b; v < e; ++v) {
+      // Merge with the sorted row of v.
+      const int* next = g.neighbors.data() + g.offsets[v];
+      const int* end = g.neighbors.data() + g.offsets[v + 1];
+      int k = c.offsets[v];
+      for (int u = 0; u < num_vertices; ++u) {
+        if (next != end && *next == u) {
+          ++next;
+        } else if (u != v) {
+          c.neighbors[k++] = u;
+        }
+      }
+    }
+  });
+  NameByIndex(&c, num_threads);
+  return c;
+}
+
+namespace ggen_internal {
+
+// Random edges tried for one repair in TryRandomRegular() before giving
+// up on the pairing.
+constexpr int kMaxRepairTries = 1000;
+
+// One try of GenerateRandomRegular() for a degree below num_vertices / 2.
+// Returns false if some repair found no edge to swap with, which can
+// happen on small graphs where every swap would make a new conflict.
+inline bool TryRandomRegular(int num_vertices, int degree, uint64_t seed,
+                             int num_threads, CSRGraph* g) {
+  assert(0 <= degree && degree < num_vertices);
+  const int64_t num_stubs = int64_t(num_vertices) * degree;
+  assert(num_stubs % 2 == 0 && num_stubs <= INT_MAX);
+
+  // Shuffle the stubs in parallel: deal them into random buckets, then
+  // shuffle each bucket. The buckets concatenated are a uniformly random
+  // permutation. Chunk and bucket counts depend only on the size, which
+  // keeps the result independent of num_threads.
+  constexpr int64_t kChunk = 1 << 16;
+  const int64_t num_chunks = (num_stubs + kChunk - 1) / kChunk;
+  const int num_buckets = std::clamp<int64_t>(num_stubs >> 18, 1, 1024);
+  std::vector<uint16_t> bucket_of(num_stubs);
+  // Stubs of chunk c in bucket b, then (after the prefix sum) where
+  // they start in the permutation.
+  std::vector<int64_t> start(num_chunks * num_buckets);
+  ParallelFor(num_chunks, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t c = b; c < e; ++c) {
+      Rng rng(seed, c);
+      for (int64_t s = c * kChunk; s < std::min(num_stubs, (c + 1) * kChunk);
+           ++s) {
+        bucket_of[s] = rng.Below(num_buckets);
+        start[c * num_buckets + bucket_of[s]] += 1;
+      }
+    }
+  });
+  std::vector<int64_t> bucket_begin(num_buckets + 1);
+  int64_t pos = 0;
+  for (int k = 0; k < num_buckets; ++k) {
+    bucket_begin[k] = pos;
+    for (int64_t c = 0; c < num_chunks; ++c) {
+      const int64_t count = start[c * num_buckets + k];
+      start[c * num_buckets + k] = pos;
+      pos += count;
+    }
+  }
+  bucket_begin[num_buckets] = pos;
+  std::vector<int> perm(num_stubs);
+  ParallelFor(num_chunks, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t c = b; c < e; ++c) {
+      for (int64_t s = c * kChunk; s < std::min(num_stubs, (c + 1) * kChunk);
+           ++s) {
+        perm[start[c * num_buckets + bucket_of[s]]++] = s;
+      }
+    }
+  });
+  bucket_of = {};
+  start = {};
+  ParallelFor(num_buckets, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t k = b; k < e; ++k) {
+      Rng rng(seed, num_chunks + k);
+      for (int64_t i = bucket_begin[k + 1] - 1; i > bucket_begin[k]; --i) {
+        std::swap(perm[i], perm[bucket_begin[k] + rng.Below(
+                                    i - bucket_begin[k] + 1)]);
+      }
+    }
+  });
+
+  // Slot s of the adjacency (row s / degree) is stub s; it connects to
+  // the vertex of the stub it is paired with.
+  std::vector<int> slots(num_stubs);
+  ParallelFor(num_stubs / 2, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t p = b; p < e; ++p) {
+      const int s = perm[2 * p];
+      const int t = perm[2 * p + 1];
+      slots[s] = t / degree;
+      slots[t] = s / degree;
+    }
+  });
+  perm = {};
+
+  // Find self-loops and repeated edges, listing each once: a loop at v
+  // appears twice in row v, a repeated edge (v, u) in rows v and u.
+  // One list per slice of the vertices.
+  const int num_slices = std::max(1, num_threads);
+  std::vector<std::vector<std::pair<int, int>>> bad(num_slices);
+  ParallelFor(num_slices, num_slices, [&](int64_t t, int64_t) {
+    std::vector<int> row(degree);
+    const int vb = int64_t(num_vertices) * t / num_slices;
+    const int ve = int64_t(num_vertices) * (t + 1) / num_slices;
+    for (int v = vb; v < ve; ++v) {
+      std::copy(&slots[int64_t(v) * degree],
+                &slots[int64_t(v) * degree] + degree, row.begin());
+      std::sort(row.begin(), row.end());
+      for (int k = 0; k < degree;) {
+        const int u = row[k];
+        const int n = std::upper_bound(row.begin() + k, row.end(), u) -
+                      row.begin() - k;
+        // A loop takes two slots; an edge to a smaller vertex is listed
+        // from that vertex's row.
+        const int extra = u == v ? n / 2 : u > v ? n - 1 : 0;
+        for (int x = 0; x < extra; ++x) bad[t].emplace_back(v, u);
+        k += n;
+      }
+    }
+  });
+
+  auto row = [&](int v) { return &slots[int64_t(v) * degree]; };
+  auto adjacent = [&](int a, int b) {
+    return std::find(row(a), row(a) + degree, b) != row(a) + degree;
+  };
+  auto replace = [&](int v, int from, int to) {
+    *std::find(row(v), row(v) + degree, from) = to;
+  };
+  // Each repair replaces (a, b) and a random edge (c, d) by (a, c) and
+  // (b, d), when that creates no new loop or repeated edge.
+  Rng rng(seed, num_chunks + num_buckets);
+  for (const auto& list : bad) {
+    for (const auto& [a, b] : list) {
+      // An earlier repair may have taken this copy as its random edge.
+      if (std::count(row(a), row(a) + degree, b) < 2) continue;
+      for (int tries = 0;; ++tries) {
+        if (tries == kMaxRepairTries) return false;
+        const int64_t s = rng.Below(num_stubs);
+        const int c = s / degree;
+        const int d = slots[s];
+        if (c == d || a == c || b == d || (a == d && b == c) ||
+            adjacent(a, c) || adjacent(b, d)) {
+          continue;
+        }
+        replace(a, b, c);
+        replace(b, a, d);
+        replace(c, d, a);
+        replace(d, c, b);
+        break;
+      }
+    }
+  }
+
+  RowsToCSR(num_vertices, degree, std::move(slots), num_threads, g);
+  assert(g->neighbors.size() == num_stubs);
+  NameByIndex(g, num_threads);
+  return true;
+}
+
+}  // namespace ggen_internal
+
+// A uniformly random simple graph in which every vertex has 'degree'
+// neighbors. Requires degree < num_vertices and an even
+// num_vertices * degree.
+//
+// Built by the configuration model: the num_vertices * degree stubs are
+// randomly permuted and paired up. The few self-loops and repeated edges
+// this makes are then removed by swapping each with a random edge. When
+// no swap works, the pairing starts over from a seed derived from
+// 'seed'; returns nullopt if 'max_tries' pairings in a row get stuck.
+//
+// Degrees of num_vertices / 2 and more are made as the complement of a
+// random graph of degree num_vertices - 1 - degree, which is just as
+// uniform, where a direct pairing would be nearly all conflicts.
+inline std::optional<CSRGraph> GenerateRandomRegular(int num_vertices,
+                                                     int degree, uint64_t seed,
+                                                     int num_threads,
+                                                     int max_tries = 100) {
+  assert(0 <= degree && degree < num_vertices);
+  if (2 * int64_t{degree} >= num_vertices) {
+    const auto complement = GenerateRandomRegular(
+        num_vertices, num_vertices - 1 - degree, seed, num_threads, max_tries);
+    if (!complement) return std::nullopt;
+    return Complement(*complement, num_threads);
+  }
+  CSRGraph g;
+  for (int t = 0; t < max_tries; ++t) {
+    if (ggen_internal::TryRandomRegular(num_vertices, degree,
+                                        t == 0 ? seed : SplitMix64(seed + t),
+                                        num_threads, &g)) {
+      return g;
+    }
+  }
+  return std::nullopt;
+}
+
+// A Watts-Strogatz small world: a ring in which each vertex is joined to
+// the 'degree' / 2 nearest on either side, after which each of those
+// edges is moved with probability 'beta' to connect its first vertex to
+// a uniformly random vertex instead. Requires an even degree below
+// num_vertices.
+//
+// Rewired edges avoid self-loops and the vertex's own ring neighborhood;
+// the rare collisions between two rewired edges are merged.
+inline CSRGraph GenerateWattsStrogatz(int num_vertices, int degree,
+                                      double beta, uint64_t seed,
+                                      int num_threads) {
+  assert(degree % 2 == 0 && 0 <= degree && degree < num_vertices);
+  const int half = degree / 2;
+  const int64_t num_edges = int64_t(num_vertices) * half;
+  assert(2 * num_edges <= INT_MAX);
+
+  // Edge (v, k) for k in [0, half) joins v and target[v * half + k].
+  std::vector<int> target(num_edges);
+  ParallelFor(num_vertices, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t v = b; v < e; ++v) {
+      Rng rng(seed, v);
+      for (int k = 0; k < half; ++k) {
+        int t = (v + k + 1) % num_vertices;
+        if (rng.Unit() < beta && num_vertices > degree + 1) {
+          // Ring distance of t from v must exceed 'half'.
+          const int64_t off = half + 1 + rng.Below(num_vertices - degree - 1);
+          t = (v + off) % num_vertices;
+        }
+        target[v * half + k] = t;
+      }
+    }
+  });
+
+  // Count both directions of every edge, then fill the rows.
+  std::vector<std::atomic<int>> fill(num_vertices + 1);
+  ParallelFor(num_edges, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t k = b; k < e; ++k) {
+      fill[k / half + 1].fetch_add(1, std::memory_order_relaxed);
+      fill[target[k] + 1].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  CSRGraph g;
+  g.offsets.assign(num_vertices + 1, 0);
+  for (int v = 0; v < num_vertices; ++v) {
+    g.offsets[v + 1] = g.offsets[v] + fill[v + 1].load();
+    fill[v].store(g.offsets[v]);
+  }
+  std::vector<int> neighbors(2 * num_edges);
+  ParallelFor(num_edges, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t k = b; k < e; ++k) {
+      const int v = k / half;
+      neighbors[fill[v].fetch_add(1, std::memory_order_relaxed)] = target[k];
+      neighbors[fill[target[k]].fetch_add(1, std::memory_order_relaxed)] = v;
+    }
+  });
+  target = {};
+  fill = std::vector<std::atomic<int>>();
+
+  // Sort rows and drop repeated edges, in place.
+  std::vector<int> size(num_vertices);
+  ParallelFor(num_vertices, num_threads, [&](int64_t b, int64_t e) {
+    for (int64_t v = b; v < e; ++v) {
+      int* begin = &neighbors[g.offsets[v]];
+      int* end = &neighbors[g.offsets[v + 1]];
+      std::sort(begin, end);
+      size[v] = std::unique(begin, end) - begin;
+    }
+  });
+  int64_t pos = 0;
+  for (int v = 0; v < num_vertices; ++v) {
+    std::copy(&neighbors[g.offsets[v]], &neighbors[g.offsets[v]] + size[v],
+              &neighbors[pos]);
+    g.offsets[v] = pos;
+    pos += size[v];
+  }
+  g.offsets[num_vertices] = pos;
+  neighbors.resize(pos);
+  g.neighbors = std::move(neighbors);
+  NameByIndex(&g, num_threads);
+  return g;
+}
+
+#endif  // GGEN_H_
@@ -8,10 +8,13 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <stdio.h>
+#include <stdint.h>
 #include <tuple>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include"rapidjson/document.h"
@@ -20,6 +23,17 @@
 //#include"rapidjson/writer.h"
 #include <rapidjson/prettywriter.h>
 
+#include "absl/container/flat_hash_set.h"
+#include "gbinary.h"
+#include "ggen.h"
+#include "gtopology.h"
+#include "gtorus_kernel.h"
+#include "json_writer.h"
+#include "profile.h"
+#include "reorder.h"
+#include "rng.h"
+#include "work_pool.h"
+
 using rapidjson::Document;
 using rapidjson::IStreamWrapper;
 using rapidjson::SizeType;
@@ -30,307 +44,874 @@ using rapidjson::PrettyWriter;
 const int live_to_live_threshold = 3;
 const int dead_to_live_threshold = 2;
 
+// A graph with a rule (see GTopology) and a state to simulate on it.
+//
+// The topology is shared by copies, so a copy costs about as much as the
+// state: drivers copy a prepared GLife per trial or per thread and set
+// the initial state. The first edit of the graph or the rule through a
+// copy gives that copy a topology of its own.
+//
+// Reorder() may renumber the vertices for memory locality. Vertex
+// indices (IsLive(), Degree(), Offsets(), GetState(), ...) are then the
+// new ones, while state strings, SetState() from words, files and the
+// edit log keep the numbering of the graph as loaded.
 class GLife {
  public:
+  // Live vertices packed one bit per vertex, 64 vertices per word.
+  // Bits past the last vertex are always zero.
+  using State = std::vector<uint64_t>;
+
   explicit GLife(const GLife& other) = default;
   // 'filename' contains the specification of a graph
-  // including its state and possibly embedding in JSON format
+  // including its state and possibly embedding in JSON format,
+  // or is a binary graph file written by SaveBinary().
+  //
+  // A JSON graph is converted to a binary cache file beside it,
+  // 'filename'.bin, which later loads use for as long as the JSON file
+  // keeps its size and modification time.
   explicit GLife(const std::string& filename) {
-    // Read and parse 'filename' in JSON format.
-    std::ifstream ifs(filename);
-    if (!ifs)
-      std::cout << "Error: " << filename << " does not exist." << std::endl;
+    GLIFE_PROFILE_SCOPE(kLoadGraph);
+    if (IsGraphFile(filename)) {
+      if (!LoadBinary(filename, nullptr)) {
+        std::cout << "Error: " << filename << " is corrupt." << std::endl;
+        exit(1);
+      }
+      return;
+    }
+    GraphFileHeader source = {};
+    const bool use_cache =
+        binary_cache_ && GraphSourceId(filename, &source.source_size,
+                                       &source.source_mtime_ns);
+    const std::string cache = filename + ".bin";
+    if (use_cache && LoadBinary(cache, &source)) return;
+    LoadJSON(filename);
+    if (use_cache) {
+      // Best effort: the directory may well be read-only.
+      SaveBinary(cache, source.source_size, source.source_mtime_ns);
+    }
+  }
 
-    IStreamWrapper isw(ifs);
-    Document doc;
-    doc.ParseStream(isw);
-    assert(doc.HasMember("vertices"));
-    const Value& vertices = doc["vertices"];
-    assert(vertices.IsArray());
-    assert(doc.HasMember("edges"));
-    const Value& arcs = doc["edges"];
-    assert(arcs.IsArray());
-    // Populate vertex adjacencies.
-    const int num_vertices = vertices.Size();
-    adjacency_.resize(num_vertices);
-    vertex_names_.resize(num_vertices);
-    for (int i = 0; i < num_vertices; ++i) {
-      assert(vertices[i].HasMember("name"));
-      vertex_names_[i] = vertices[i]["name"].GetString();
-      name_to_index_[vertex_names_[i]] = i;
-      if (vertices[i].HasMember("state"))
-        {
-          assert(vertices[i]["state"].IsBool());
-          if (vertices[i]["state"].GetBool()) // active state
-            SetLiveVertex(vertex_names_[i]);
-        }
+  // Take over a graph built in memory, e.g. by one of the generators in
+  // ggen.h. All vertices start dead.
+  explicit GLife(CSRGraph graph) {
+    assert(graph.names.size() == graph.NumVertices());
+    topology_->SetCSR(std::move(graph.offsets), std::move(graph.neighbors));
+    topology_->SetVertexNames(std::move(graph.names));
+    if (graph.torus_size > 0) topology_->SetTorus(graph.torus_size);
+    state_.assign(NumWords(NumVertices()), 0);
+    next_.assign(state_.size(), 0);
+  }
+
+  // Whether to use and create binary caches of JSON graphs.
+  static void SetBinaryCache(bool enabled) { binary_cache_ = enabled; }
+
+  // Write the graph, including its current state, as a binary graph
+  // file. 'source_size' and 'source_mtime_ns' identify the JSON file
+  // it was converted from, if any. Returns false on I/O errors.
+  bool SaveBinary(const std::string& filename, int64_t source_size = 0,
+                  int64_t source_mtime_ns = 0) const {
+    if (Reordered()) {
+      return Unreordered()->SaveBinary(filename, source_size, source_mtime_ns);
     }
-    const int num_arcs = arcs.Size();
-    for (int i = 0; i < num_arcs; ++i) {
-      const std::string v1 = arcs[i]["s"].GetString();
-      const auto it1 = name_to_index_.find(v1);
-      assert(it1 != name_to_index_.end());
-      const int index1 = it1->second;
-      const std::string v2 = arcs[i]["t"].GetString();
-      const auto it2 = name_to_index_.find(v2);
-      assert(it2 != name_to_index_.end());
-      const int index2 = it2->second;
-      // We treat all arcs as undirected.
-      adjacency_[index1].insert(index2);
-      adjacency_[index2].insert(index1);
+    GraphFileHeader h = {};
+    memcpy(h.magic, GraphFileHeader::kMagic, sizeof(h.magic));
+    h.header_size = sizeof(h);
+    const GTopology& topology = *topology_;
+    const auto& names = topology.VertexNames();
+    h.torus_size = topology.Torus() ? topology.Torus()->size() : 0;
+    h.num_vertices = NumVertices();
+    h.num_neighbors = topology.Neighbors().size();
+    std::vector<int64_t> name_offsets(NumVertices() + 1);
+    for (int i = 0; i < NumVertices(); ++i) {
+      name_offsets[i + 1] = name_offsets[i] + names[i].size();
+    }
+    h.names_size = name_offsets.back();
+    h.source_size = source_size;
+    h.source_mtime_ns = source_mtime_ns;
+    const GraphFileLayout layout(h);
+
+    // Write to a temporary file and rename it into place, so concurrent
+    // readers never see a partial file.
+    const std::string tmp = filename + ".tmp." + std::to_string(getpid());
+    std::ofstream ofs(tmp, std::ios::binary);
+    auto pad_to = [&ofs](int64_t pos) {
+      static const char zeros[8] = {};
+      ofs.write(zeros, pos - ofs.tellp());
+    };
+    ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    pad_to(layout.offsets);
+    ofs.write(reinterpret_cast<const char*>(topology.Offsets().data()),
+              4 * topology.Offsets().size());
+    pad_to(layout.neighbors);
+    ofs.write(reinterpret_cast<const char*>(topology.Neighbors().data()),
+              4 * topology.Neighbors().size());
+    pad_to(layout.name_offsets);
+    ofs.write(reinterpret_cast<const char*>(name_offsets.data()),
+              8 * name_offsets.size());
+    for (const auto& name : names) ofs.write(name.data(), name.size());
+    pad_to(layout.state);
+    ofs.write(reinterpret_cast<const char*>(state_.data()), 8 * state_.size());
+    ofs.close();
+    if (!ofs || rename(tmp.c_str(), filename.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
     }
+    return true;
   }
 
+  int NumVertices() const { return topology_->NumVertices(); }
+  int Degree(int i) const { return topology_->Degree(i); }
+
+  // The CSR topology: the neighbors of vertex i are Neighbors()[k] for
+  // k in [Offsets()[i], Offsets()[i + 1]).
+  const std::vector<int>& Offsets() const { return topology_->Offsets(); }
+  const std::vector<int>& Neighbors() const { return topology_->Neighbors(); }
+
+  // True if 'a' and 'b' are connected.
+  bool HasEdge(int a, int b) const { return topology_->HasEdge(a, b); }
+
+  // The graph and rule, for simulators that keep them beyond the life of
+  // this GLife, e.g. GLifeMulti. Editing this GLife afterwards leaves the
+  // returned topology as it was.
+  std::shared_ptr<const GTopology> Topology() const { return topology_; }
+
   // Output a string representing the state of the graph
   std::string GetStateStr() {
-    const size_t size = adjacency_.size();
+    GLIFE_PROFILE_SCOPE(kGetStateStr);
+    const size_t size = NumVertices();
     std::string state(size, '.');
-    for (int i = 0; i < size; ++i) {
-      if (state_.find(i) != state_.end()) {
-        state[i] = '1';
+    const GTopology& topology = *topology_;
+    for (int w = 0; w < state_.size(); ++w) {
+      for (uint64_t bits = state_[w]; bits != 0; bits &= bits - 1) {
+        state[topology.Original(64 * w + __builtin_ctzll(bits))] = '1';
       }
     }
     return state;
   }
 
+  // Packed state, suitable for hashing and comparison. Bit i is vertex
+  // i in the current numbering (see Reorder()).
+  const State& GetState() const { return state_; }
+
+  // 64-bit fingerprint of the current state; equal states have equal
+  // fingerprints. It is a sum of independently mixed words, so partial
+  // sums over word ranges can be added up.
+  uint64_t Fingerprint() const {
+    ParallelTeam* team = team_.Get();
+    if (team == nullptr) return FingerprintWords(0, state_.size());
+    std::vector<uint64_t> sums(team->num_threads());
+    team->Run([&](int part) {
+      const auto [begin, end] = team->Range(state_.size(), part);
+      sums[part] = FingerprintWords(begin, end);
+    });
+    uint64_t h = 0;
+    for (uint64_t sum : sums) h += sum;
+    return h;
+  }
+
+  static uint64_t MixWord(uint64_t word, uint64_t index) {
+    // splitmix64 finalizer.
+    uint64_t z = word + (index + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  bool IsLive(int i) const { return (state_[i >> 6] >> (i & 63)) & 1; }
+
+  // Number of live vertices.
+  int NumLive() const {
+    int count = 0;
+    for (uint64_t w : state_) count += __builtin_popcountll(w);
+    return count;
+  }
+
   // Set state from a given state string
   // Inverse of GetStateStr();
   void SetState(const std::string& state) {
-    assert(state.size() == adjacency_.size());
-    state_.clear();
+    assert(state.size() == NumVertices());
+    std::fill(state_.begin(), state_.end(), 0);
+    counts_valid_ = false;
+    const GTopology& topology = *topology_;
     for (int j = 0; j < state.size(); j++) {
       if (state[j] == '1') {
-        state_.insert(j);
+        const int i = topology.Internal(j);
+        state_[i >> 6] |= uint64_t{1} << (i & 63);
+      }
+    }
+  }
+
+  // Set state from NumWords(NumVertices()) words laid out as a State in
+  // the numbering of the graph as loaded, e.g. a row of a packed states
+  // file.
+  void SetState(const uint64_t* words) {
+    counts_valid_ = false;
+    if (Reordered()) {
+      const std::vector<int>& internal = topology_->InternalIndex();
+      std::fill(state_.begin(), state_.end(), 0);
+      for (int w = 0; w < state_.size(); ++w) {
+        for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+          const int v = 64 * w + __builtin_ctzll(bits);
+          if (v >= NumVertices()) break;
+          state_[internal[v] >> 6] |= uint64_t{1} << (internal[v] & 63);
+        }
       }
+      return;
     }
+    std::copy(words, words + state_.size(), state_.begin());
+    if (NumVertices() % 64 != 0) {
+      state_.back() &= (uint64_t{1} << (NumVertices() % 64)) - 1;
+    }
+  }
+
+  // Set state from a packed state in the current numbering, e.g. one
+  // returned by GetState().
+  void SetState(const State& state) {
+    assert(state.size() == state_.size());
+    state_ = state;
+    counts_valid_ = false;
   }
 
   // Classical Conway rules
   static bool NewStateConway(bool current_state, int num_neighbors,
                       int num_live_neighbors) {
-    if (num_live_neighbors < 2) return false;
-    if (num_live_neighbors == 2) return current_state;
-    if (num_live_neighbors == 3) return true;
-    return false;
+    return GTopology::NewStateConway(current_state, num_neighbors,
+                                     num_live_neighbors);
   }
 
+  // 'fn' must be a pure function of its arguments: it is tabulated for
+  // every (current state, degree, live neighbor count) combination that
+  // can occur in this graph, and Update() only consults the table.
   void SetNewStateFn(std::function<bool(bool, int, int)> fn) {
-    new_state_fn_ = std::move(fn);
+    MutableTopology().SetNewStateFn(std::move(fn));
+    counts_valid_ = false;
   }
 
+  const std::function<bool(bool, int, int)>& NewStateFn() const {
+    return topology_->NewStateFn();
+  }
+
+  // In incremental mode Update() keeps a live-neighbor count per vertex,
+  // adjusts it only when a neighbor flips, and re-evaluates the rule only
+  // for vertices that flipped in the previous step and their neighbors.
+  // Step cost then scales with activity rather than with graph size.
+  void SetIncremental(bool incremental) {
+    incremental_ = incremental;
+    counts_valid_ = false;
+  }
+
+  // Run each Update() on 'num_threads' threads, for very large graphs.
+  // The vertices are split into one contiguous range per thread, of
+  // about equal numbers of arcs, so that most neighbors are in the same
+  // range on graphs numbered with locality, such as GTorus; the threads
+  // meet once per generation. Fingerprint() and EntropyAccumulator::Add()
+  // also split their words over these threads. The threads start on
+  // first use and are shared by all copies used on the same thread (see
+  // LazyTeam). Not used in incremental mode.
+  void SetUpdateThreads(int num_threads) {
+    team_.SetNumThreads(num_threads);
+    parts_.clear();
+  }
+
+  // The threads set by SetUpdateThreads(), or null.
+  ParallelTeam* Team() const { return team_.Get(); }
+
+  // Renumber the vertices in 'order' (see reorder.h), so that neighbors
+  // tend to share cache lines and Update() reads memory close to what it
+  // writes. Outputs are unchanged; see the class comment. Graph edits
+  // undo nothing, so reorder again after heavy rewiring. Returns false,
+  // leaving the graph as it was, if the vertices cannot be ordered that
+  // way. Any torus kernel is dropped.
+  bool Reorder(VertexOrder order) {
+    std::vector<int> permutation;
+    switch (order) {
+      case VertexOrder::kBFS:
+        permutation = BFSOrder(*topology_);
+        break;
+      case VertexOrder::kRCM:
+        permutation = RCMOrder(*topology_);
+        break;
+      case VertexOrder::kHilbert:
+        if (!HilbertOrder(*topology_, &permutation)) return false;
+        break;
+    }
+    Permute(permutation);
+    return true;
+  }
+
+  // True if Reorder() changed the numbering.
+  bool Reordered() const { return !topology_->OriginalIndex().empty(); }
+
   // Simulate one step of life on the underlying graph
   void Update() {
-    std::unordered_set<int> next;
-    for (int i = 0; i < adjacency_.size(); ++i) {
-      const std::unordered_set<int>& neighbors = adjacency_[i];
-      std::vector<int> live_neighbors(
-        std::min(state_.size(), neighbors.size()));
-      const int num_live = std::count_if(neighbors.begin(), neighbors.end(),
-           [this](const int id) { return state_.find(id) != state_.end(); });
-      bool live = state_.find(i) != state_.end();
-      live = new_state_fn_(live, neighbors.size(), num_live);
-      if (live) {
-        next.insert(i);
-      }
+    GLIFE_PROFILE_SCOPE(kUpdate);
+    GLIFE_PROFILE_COUNT(kSteps, 1);
+    if (incremental_) {
+      UpdateIncremental();
+      return;
+    }
+    GLIFE_PROFILE_COUNT(kCellsEvaluated, NumVertices());
+    const GTopology& topology = *topology_;
+    if (ParallelTeam* team = team_.Get()) {
+      if (parts_.empty()) Partition(team->num_threads());
+      team->Run([&](int part) {
+        if (parts_[part] == parts_[part + 1]) return;
+        if (topology.Torus()) {
+          topology.Torus()->StepRows(state_.data(), next_.data(),
+                                     parts_[part], parts_[part + 1],
+                                     &part_scratch_[part]);
+        } else {
+          UpdateWords(parts_[part], parts_[part + 1]);
+        }
+      });
+    } else if (topology.Torus()) {
+      topology.Torus()->Step(state_.data(), next_.data(), &torus_scratch_);
+    } else {
+      UpdateWords(0, next_.size());
     }
-    state_.swap(next);
+    state_.swap(next_);
   }
 
   void OutputLiveAnnotations() {
-    for (int i = 0; i < adjacency_.size(); ++i) {
-      std::cout << vertex_names_[i] << ": ";
-      const std::unordered_set<int>& neighbors = adjacency_[i];
-      for (int j : neighbors) {
-        bool live = state_.find(j) != state_.end();
+    if (Reordered()) {
+      Unreordered()->OutputLiveAnnotations();
+      return;
+    }
+    const std::vector<int>& offsets = Offsets();
+    const std::vector<int>& neighbors = Neighbors();
+    const auto& names = topology_->VertexNames();
+    for (int i = 0; i < NumVertices(); ++i) {
+      std::cout << names[i] << ": ";
+      for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+        const int j = neighbors[k];
+        bool live = IsLive(j);
         std::string annotation = live ? "*" : "";
-        std::cout << vertex_names_[j] << annotation << " ";
+        std::cout << names[j] << annotation << " ";
       }
       std::cout << std::endl;
     }
   }
 
-  // Select two random Edges [a,b] and [c,d] such that
-  // [a,b] and [c,d] can be removed and [a,c] and [b,d]
-  // can be connected without violation of "each node has 8 neighbors"
-  // property.
+  // Select two random edges [a,b] and [c,d], uniformly among edges and
+  // their orientations, such that [a,b] and [c,d] can be replaced by
+  // [a,c] and [b,d] without changing any vertex degree or creating a
+  // duplicate edge or a loop. Returns nullopt when the draw is unusable.
   std::optional<std::array<int, 4>> SelectRandomEdges() {
-    const int a = rand() % adjacency_.size();
-    const int c = rand() % adjacency_.size();
-    if (a == c) return std::nullopt;
-    auto& a_neighbors = adjacency_[a];
-    if (a_neighbors.find(c) != a_neighbors.end()) {
-      // We picked directly connected nodes. Try again.
-      return std::nullopt;
-    }
-    auto a_iter = a_neighbors.begin();
-    std::advance(a_iter, rand() % a_neighbors.size());
-    const int b = *a_iter;
-
-    auto& c_neighbors = adjacency_[c];
-    if (c_neighbors.find(b) != c_neighbors.end()) {
-      return std::nullopt;
-    }
-    auto c_iter = c_neighbors.begin();
-    std::advance(c_iter, rand() % c_neighbors.size());
-    const int d = *c_iter;
-
-    auto& b_neighbors = adjacency_[b];
-    if (b_neighbors.find(d) != b_neighbors.end()) {
+    const std::vector<int>& source = MutableTopology().ArcSources();
+    const std::vector<int>& neighbors = Neighbors();
+    if (source.size() < 4) return std::nullopt;
+    Rng& rng = ThreadRng();
+    const int k = rng.Below(source.size());
+    const int l = rng.Below(source.size());
+    const int a = source[k], b = neighbors[k];
+    const int c = source[l], d = neighbors[l];
+    if (a == b || a == c || a == d || b == c || b == d || c == d) {
       return std::nullopt;
     }
+    if (HasEdge(a, c) || HasEdge(b, d)) return std::nullopt;
     return std::array<int, 4>{a, b, c, d};
   }
 
   void AddEdge(int a, int b) {
     assert(a != b);
-    auto &a_neighbors = adjacency_[a];
-    auto &b_neighbors = adjacency_[b];
-
-    assert(a_neighbors.find(b) == a_neighbors.end());
-    assert(b_neighbors.find(a) == b_neighbors.end());
+    assert(!HasEdge(a, b));
+    assert(!HasEdge(b, a));
 
-    a_neighbors.insert(b);
-    b_neighbors.insert(a);
+    GTopology& topology = MutableTopology();
+    topology.InsertNeighbor(a, b);
+    topology.InsertNeighbor(b, a);
+    counts_valid_ = false;
   }
 
   void RemoveEdge(int a, int b) {
-    size_t n = adjacency_[a].erase(b);
-    assert(n == 1);
-    n = adjacency_[b].erase(a);
-    assert(n == 1);
+    assert(HasEdge(a, b));
+    assert(HasEdge(b, a));
+
+    GTopology& topology = MutableTopology();
+    topology.EraseNeighbor(a, b);
+    topology.EraseNeighbor(b, a);
+    counts_valid_ = false;
   }
 
   bool ReWireRandomEdges() {
     auto e = SelectRandomEdges();
     if (!e) return false;
-    auto &arr = e.value();
-    int a = arr[0];
-    int b = arr[1];
-    int c = arr[2];
-    int d = arr[3];
-    std::cerr << "Rewire " << a << "<->" << b << 
-        " and " << c << "<->" << d << " to " <<
-        a << "<->" << c << " and " << b << "<->" << d <<
-        std::endl;
-
-    auto& a_neighbors = adjacency_[a];
-    auto& b_neighbors = adjacency_[b];
-    auto& c_neighbors = adjacency_[c];
-    auto& d_neighbors = adjacency_[d];
-
-    // Remove a<->b edge.
-    RemoveEdge(a, b);
-    assert(a_neighbors.size() == 7);
-    assert(b_neighbors.size() == 7);
-
-    // Remove c<->d edge.
-    RemoveEdge(c, d);
-    assert(c_neighbors.size() == 7);
-    assert(d_neighbors.size() == 7);
-
-    // Connect a<->c.
-    a_neighbors.insert(c);
-    c_neighbors.insert(a);
-
-    // Connect b<->d.
-    b_neighbors.insert(d);
-    d_neighbors.insert(b);
+    const auto [a, b, c, d] = e.value();
+    if (edit_log_) {
+      const int oa = topology_->Original(a), ob = topology_->Original(b);
+      const int oc = topology_->Original(c), od = topology_->Original(d);
+      *edit_log_ << "Rewire " << oa << "<->" << ob << " and " << oc << "<->"
+                 << od << " to " << oa << "<->" << oc << " and " << ob
+                 << "<->" << od << "\n";
+    }
+
+    // Replace a<->b and c<->d by a<->c and b<->d. Degrees are preserved,
+    // so the CSR rows are patched in place.
+    GTopology& topology = MutableTopology();
+    topology.ReplaceNeighbor(a, b, c);
+    topology.ReplaceNeighbor(b, a, d);
+    topology.ReplaceNeighbor(c, d, a);
+    topology.ReplaceNeighbor(d, c, b);
+    counts_valid_ = false;
 
     return true;
   }
 
+  // Add n edges between distinct, unconnected vertices drawn uniformly at
+  // random.
   void AddEdges(int n) {
+    const int64_t num_vertices = NumVertices();
+    assert(int64_t(Neighbors().size()) / 2 + n <=
+           num_vertices * (num_vertices - 1) / 2);
+    std::vector<std::pair<int, int>> arcs = topology_->Arcs();
+    absl::flat_hash_set<std::pair<int, int>> added;
+    Rng& rng = ThreadRng();
     while (n > 0) {
-      auto e = SelectRandomEdges();
-      if (!e) continue;
-      auto& arr = e.value();
-      AddEdge(arr[0], arr[1]);
-      n -= 1;
-      if (n <= 0) break;
-      AddEdge(arr[2], arr[3]);
+      const int a = rng.Below(num_vertices);
+      const int b = rng.Below(num_vertices);
+      if (a == b || HasEdge(a, b) ||
+          !added.insert(std::minmax(a, b)).second) {
+        continue;
+      }
+      if (edit_log_) {
+        *edit_log_ << "Add " << topology_->Original(a) << "<->"
+                   << topology_->Original(b) << "\n";
+      }
+      arcs.emplace_back(a, b);
+      arcs.emplace_back(b, a);
       n -= 1;
     }
+    RebuildCSR(arcs);
   }
 
+  // Remove n edges drawn uniformly at random, or all if there are fewer.
   void RemoveEdges(int n) {
-    while (n > 0) {
-      auto e = SelectRandomEdges();
-      if (!e) continue;
-      auto& arr = e.value();
-      RemoveEdge(arr[0], arr[1]);
-      n -= 1;
-      if (n <= 0) break;
-      RemoveEdge(arr[2], arr[3]);
-      n -= 1;
+    // Each edge once, as its arc from the smaller vertex.
+    std::vector<std::pair<int, int>> edges;
+    for (const auto& [a, b] : topology_->Arcs()) {
+      if (a <= b) edges.emplace_back(a, b);
+    }
+    // The removed edges are moved to the end by a partial shuffle.
+    Rng& rng = ThreadRng();
+    n = std::clamp<int64_t>(n, 0, edges.size());
+    for (int i = 0; i < n; ++i) {
+      const int last = edges.size() - 1 - i;
+      std::swap(edges[rng.Below(last + 1)], edges[last]);
+      if (edit_log_) {
+        *edit_log_ << "Remove " << topology_->Original(edges[last].first)
+                   << "<->" << topology_->Original(edges[last].second)
+                   << "\n";
+      }
     }
+    edges.resize(edges.size() - n);
+    std::vector<std::pair<int, int>> arcs;
+    arcs.reserve(2 * edges.size());
+    for (const auto& [a, b] : edges) {
+      arcs.emplace_back(a, b);
+      arcs.emplace_back(b, a);
+    }
+    RebuildCSR(arcs);
   }
 
-  // Rewire n edges at random.
-  void ReWire(int n) {
+  // Rewire n edges at random. A swap is given up after
+  // kMaxRewireTries unusable draws, as on graphs with fewer than two
+  // edges or complete ones, where no swap exists. Returns the number of
+  // swaps made.
+  int ReWire(int n) {
     for (int j = 0; j < n; j++) {
+      int tries = 0;
       while (!ReWireRandomEdges()) {
-        // Failed for some reason. Try again.
+        if (++tries == kMaxRewireTries) return j;
       }
     }
+    return std::max(n, 0);
   }
 
-  void DumpToJSON(const std::string& filename) {
-    std::ofstream outjson;
-    outjson.open(filename);
-    outjson << "{" << std::endl;
-    outjson << "\"vertices\" : [" << std::endl;
-    for (int index = 0; index < adjacency_.size(); ++index) {
-      outjson << "{ \"name\" : \"" << vertex_names_[index] << "\"";
-      bool live = state_.find(index) != state_.end();
-      if (live) {
-        outjson << ", \"state\" : true ";
+  // Unusable draws in a row after which ReWire() gives up a swap.
+  static constexpr int kMaxRewireTries = 10000;
+
+  // Describe each edit made by ReWire(), AddEdges() and RemoveEdges() on
+  // 'log', or nowhere if null (the default).
+  static void SetEditLog(std::ostream* log) { edit_log_ = log; }
+
+  // With 'compact', each undirected edge is written once instead of
+  // once per direction.
+  void DumpToJSON(const std::string& filename, bool compact = false) const {
+    if (Reordered()) {
+      Unreordered()->DumpToJSON(filename, compact);
+      return;
+    }
+    GLIFE_PROFILE_SCOPE(kDumpJSON);
+    const GTopology& topology = *topology_;
+    const auto& names = topology.VertexNames();
+    GraphJSONWriter out(filename);
+    if (topology.Torus()) {
+      // Lets the loader pick the torus kernel again.
+      out.Field("name", "Torus");
+      out.Field("size", topology.Torus()->size());
+    }
+    out.BeginVertices();
+    const int num_vertices = NumVertices();
+    for (int index = 0; index < num_vertices; ++index) {
+      out.Vertex(names[index], IsLive(index));
+    }
+    out.BeginEdges();
+    for (int index = 0; index < num_vertices; ++index) {
+      for (int k = topology.Offsets()[index]; k < topology.Offsets()[index + 1];
+           ++k) {
+        const int j = topology.Neighbors()[k];
+        if (compact && j < index) continue;
+        out.Edge(names[index], names[j]);
       }
-       
-      outjson << "}";
-      if (index < adjacency_.size() - 1)
-        outjson << ",";
-      outjson << std::endl;
-    }
-    outjson << "]," << std::endl; // end of vertices
-    outjson << "\"edges\" : [" << std::endl;
-    for (int index = 0; index < adjacency_.size(); ++index) {
-      const auto& neighbors = adjacency_[index]; 
-      int i = 0;
-      for (int j : neighbors) {
-        outjson << "{ \"s\" : \"" << vertex_names_[index] << "\","
-                << " \"t\" : \"" << vertex_names_[j] << "\" }";
-        if (!(index == adjacency_.size() - 1 && i == neighbors.size() - 1))
-          outjson << ",";
-        outjson << std::endl;
-        i++;
-      } 
-    }
-    outjson << "]}" << std::endl; // end of edges
-    outjson.close();
+    }
+    out.EndEdges();
+    if (!out.Close()) {
+      std::cerr << "Error: could not write " << filename << std::endl;
+    }
   }
 
  private:
-  std::function<bool(bool, int, int)> new_state_fn_ = NewStateConway;
-  // A representation of the underlying graph.
-  std::vector<std::unordered_set<int>> adjacency_;
-  // Active vertices.
-  std::unordered_set<int> state_;
-  // Original vertex names.
-  std::vector<std::string> vertex_names_;
-  std::unordered_map<std::string, int> name_to_index_;
+  // Shared with copies; see MutableTopology().
+  std::shared_ptr<GTopology> topology_ = std::make_shared<GTopology>();
+  // Active vertices, and the buffer the next generation is built in.
+  State state_;
+  State next_;
+  // Working buffers of the torus kernel.
+  GTorusKernel::Scratch torus_scratch_;
+  // See SetUpdateThreads(). Part p of Update() is parts_[p] to
+  // parts_[p + 1], in torus rows or state words, with its own kernel
+  // buffers; empty until computed.
+  LazyTeam team_;
+  std::vector<int> parts_;
+  std::vector<GTorusKernel::Scratch> part_scratch_;
+
+  // See SetBinaryCache().
+  static inline bool binary_cache_ = true;
+  // See SetEditLog().
+  static inline std::ostream* edit_log_ = nullptr;
+
+  // Next state words [w_begin, w_end) by the general CSR code.
+  void UpdateWords(int w_begin, int w_end) {
+    const GTopology& topology = *topology_;
+    const std::vector<int>& offsets = topology.Offsets();
+    const std::vector<int>& neighbors = topology.Neighbors();
+    const int num_vertices = NumVertices();
+    for (int w = w_begin; w < w_end; ++w) {
+      uint64_t bits = 0;
+      const int last = std::min(64, num_vertices - 64 * w);
+      for (int b = 0; b < last; ++b) {
+        const int i = 64 * w + b;
+        const int begin = offsets[i];
+        const int end = offsets[i + 1];
+        int num_live = 0;
+        for (int k = begin; k < end; ++k) {
+          num_live += IsLive(neighbors[k]);
+        }
+        bits |= uint64_t{topology.NextState(IsLive(i), end - begin, num_live)}
+                << b;
+      }
+      next_[w] = bits;
+    }
+  }
+
+  uint64_t FingerprintWords(size_t begin, size_t end) const {
+    uint64_t h = 0;
+    for (size_t w = begin; w < end; ++w) h += MixWord(state_[w], w);
+    return h;
+  }
+
+  // Split Update() into 'n' parts (see SetUpdateThreads()): ranges of
+  // torus rows that fill whole words, or else ranges of state words, of
+  // about equal cost.
+  void Partition(int n) {
+    const GTopology& topology = *topology_;
+    parts_.assign(n + 1, 0);
+    if (topology.Torus()) {
+      const int size = topology.Torus()->size();
+      const int unit = topology.Torus()->RowAlignment();
+      for (int p = 1; p < n; ++p) {
+        parts_[p] = std::min(size, int(int64_t(size) * p / n / unit * unit));
+      }
+      parts_[n] = size;
+    } else {
+      // A vertex costs one rule lookup plus one load per arc.
+      const std::vector<int>& offsets = topology.Offsets();
+      const int64_t total = int64_t(offsets.back()) + NumVertices();
+      for (int p = 1; p < n; ++p) {
+        const int64_t target = total * p / n;
+        int lo = 0, hi = NumVertices();
+        while (lo < hi) {
+          const int mid = (lo + hi) / 2;
+          if (int64_t(offsets[mid]) + mid < target) {
+            lo = mid + 1;
+          } else {
+            hi = mid;
+          }
+        }
+        parts_[p] = std::max(parts_[p - 1], (lo + 32) / 64);
+      }
+      parts_[n] = next_.size();
+      for (int p = 1; p < n; ++p) parts_[p] = std::min(parts_[p], parts_[n]);
+    }
+    part_scratch_.resize(n);
+  }
+
+  // The topology, for editing: copied first if another GLife shares it.
+  GTopology& MutableTopology() {
+    parts_.clear();
+    if (topology_.use_count() > 1) {
+      topology_ = std::make_shared<GTopology>(*topology_);
+    }
+    return *topology_;
+  }
+
+  // Renumber vertex 'order[k]' as k, moving its state bit along.
+  void Permute(const std::vector<int>& order) {
+    State state(state_.size());
+    for (int k = 0; k < order.size(); ++k) {
+      if (IsLive(order[k])) state[k >> 6] |= uint64_t{1} << (k & 63);
+    }
+    state_.swap(state);
+    MutableTopology().Permute(order);
+    counts_valid_ = false;
+  }
+
+  // A copy in the numbering of the graph as loaded, for output.
+  std::unique_ptr<GLife> Unreordered() const {
+    auto copy = std::make_unique<GLife>(*this);
+    copy->Permute(topology_->InternalIndex());
+    return copy;
+  }
+
+  // Replace the topology by 'arcs' after edits that change degrees, at
+  // O(edges) for the whole batch.
+  void RebuildCSR(const std::vector<std::pair<int, int>>& arcs) {
+    MutableTopology().BuildCSR(NumVertices(), arcs);
+    counts_valid_ = false;
+  }
+
+  // Read and parse 'filename' in JSON format.
+  void LoadJSON(const std::string& filename) {
+    std::ifstream ifs(filename);
+    if (!ifs)
+      std::cout << "Error: " << filename << " does not exist." << std::endl;
+
+    IStreamWrapper isw(ifs);
+    Document doc;
+    doc.ParseStream(isw);
+    assert(doc.HasMember("vertices"));
+    const Value& vertices = doc["vertices"];
+    assert(vertices.IsArray());
+    assert(doc.HasMember("edges"));
+    const Value& arcs = doc["edges"];
+    assert(arcs.IsArray());
+    // Populate vertex adjacencies.
+    const int num_vertices = vertices.Size();
+    std::vector<std::string> names(num_vertices);
+    std::unordered_map<std::string, int> name_to_index;
+    state_.assign(NumWords(num_vertices), 0);
+    next_.assign(NumWords(num_vertices), 0);
+    for (int i = 0; i < num_vertices; ++i) {
+      assert(vertices[i].HasMember("name"));
+      names[i] = vertices[i]["name"].GetString();
+      name_to_index[names[i]] = i;
+      if (vertices[i].HasMember("state"))
+        {
+          assert(vertices[i]["state"].IsBool());
+          if (vertices[i]["state"].GetBool()) // active state
+            state_[i >> 6] |= uint64_t{1} << (i & 63);
+        }
+    }
+    const int num_arcs = arcs.Size();
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(2 * num_arcs);
+    for (int i = 0; i < num_arcs; ++i) {
+      const std::string v1 = arcs[i]["s"].GetString();
+      const auto it1 = name_to_index.find(v1);
+      assert(it1 != name_to_index.end());
+      const int index1 = it1->second;
+      const std::string v2 = arcs[i]["t"].GetString();
+      const auto it2 = name_to_index.find(v2);
+      assert(it2 != name_to_index.end());
+      const int index2 = it2->second;
+      // We treat all arcs as undirected.
+      edges.emplace_back(index1, index2);
+      edges.emplace_back(index2, index1);
+    }
+    // A fresh GLife does not share its topology yet.
+    GTopology& topology = *topology_;
+    topology.SetVertexNames(std::move(names));
+    topology.BuildCSR(num_vertices, edges);
+
+    // Graphs written by GTorus carry their size. Use the bit-parallel
+    // torus kernel when the graph really is that torus.
+    if (doc.HasMember("name") && doc["name"].IsString() &&
+        std::string(doc["name"].GetString()) == "Torus" &&
+        doc.HasMember("size") && doc["size"].IsNumber()) {
+      const int n = doc["size"].GetDouble();
+      if (topology.IsTorus(n)) topology.SetTorus(n);
+    }
+  }
 
-  // Add vertex 'i' to the live vertices.
-  void SetLiveVertex(const std::string& name) {
-    const auto it = name_to_index_.find(name);
-    if (it == name_to_index_.end()) {
-      std::cout << "Error: invalid vertex " << name << std::endl;
-      exit(1);
+  // Load a binary graph file. If 'source' is given, the file must have
+  // been converted from that version of the source. Returns false if
+  // the file is missing, corrupt or stale; a cache beside a JSON file is
+  // only a copy, so everything is checked before it is used.
+  bool LoadBinary(const std::string& filename, const GraphFileHeader* source) {
+    const MappedFile file(filename);
+    if (!file.ok() || file.size() < sizeof(GraphFileHeader)) return false;
+    GraphFileHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    // Bound the counts by the file size first, so the layout cannot
+    // overflow.
+    if (memcmp(h.magic, GraphFileHeader::kMagic, sizeof(h.magic)) != 0 ||
+        h.header_size != sizeof(h) || h.num_vertices < 0 ||
+        h.num_neighbors < 0 || h.names_size < 0 ||
+        h.num_vertices >= file.size() / 4 ||
+        h.num_neighbors > file.size() / 4 || h.names_size > file.size() ||
+        h.num_neighbors > std::numeric_limits<int>::max()) {
+      return false;
+    }
+    if (source != nullptr && (h.source_size != source->source_size ||
+                              h.source_mtime_ns != source->source_mtime_ns)) {
+      return false;
+    }
+    const GraphFileLayout layout(h);
+    if (layout.size > file.size()) return false;
+
+    const int num_vertices = h.num_vertices;
+    const char* data = file.data();
+    const int32_t* offsets =
+        reinterpret_cast<const int32_t*>(data + layout.offsets);
+    const int32_t* neighbors =
+        reinterpret_cast<const int32_t*>(data + layout.neighbors);
+    const int64_t* name_offsets =
+        reinterpret_cast<const int64_t*>(data + layout.name_offsets);
+    if (offsets[0] != 0 || offsets[num_vertices] != h.num_neighbors ||
+        name_offsets[0] != 0 || name_offsets[num_vertices] != h.names_size) {
+      return false;
     }
+    // Rows must be in order and hold sorted, distinct vertices.
+    for (int i = 0; i < num_vertices; ++i) {
+      if (offsets[i + 1] < offsets[i] ||
+          name_offsets[i + 1] < name_offsets[i]) {
+        return false;
+      }
+      for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+        if (neighbors[k] < 0 || neighbors[k] >= num_vertices ||
+            (k > offsets[i] && neighbors[k] <= neighbors[k - 1])) {
+          return false;
+        }
+      }
+    }
+    if (h.torus_size != 0 &&
+        (h.torus_size < 0 ||
+         int64_t{h.torus_size} * h.torus_size != num_vertices)) {
+      return false;
+    }
+    // A state with bits past the last vertex is corrupt too.
+    State state(NumWords(num_vertices));
+    memcpy(state.data(), data + layout.state, 8 * state.size());
+    if (num_vertices % 64 != 0 &&
+        (state.back() >> (num_vertices % 64)) != 0) {
+      return false;
+    }
+
+    // The mapping goes away on return: the topology may be edited later,
+    // so the arrays are copied out rather than used in place.
+    std::vector<std::string> names(num_vertices);
+    for (int i = 0; i < num_vertices; ++i) {
+      names[i].assign(data + layout.names + name_offsets[i],
+                      name_offsets[i + 1] - name_offsets[i]);
+    }
+    GTopology& topology = *topology_;
+    topology.SetCSR(std::vector<int>(offsets, offsets + num_vertices + 1),
+                    std::vector<int>(neighbors, neighbors + h.num_neighbors));
+    topology.SetVertexNames(std::move(names));
+    if (h.torus_size > 0) {
+      // The torus kernel trusts the graph to be that torus; a caller
+      // falling back to the JSON file replaces this topology.
+      if (!topology.IsTorus(h.torus_size)) return false;
+      topology.SetTorus(h.torus_size);
+    }
+    state_.swap(state);
+    next_.assign(state_.size(), 0);
+    return true;
+  }
 
-    const int index = it->second;
-    state_.insert(index);
+  // Incremental update mode (see SetIncremental()).
+  bool incremental_ = false;
+  // False when 'live_count_' and 'frontier_' must be recomputed because
+  // the state, the topology or the rule changed behind our back.
+  bool counts_valid_ = false;
+  // Number of live neighbors of each vertex.
+  std::vector<int> live_count_;
+  // Vertices whose rule must be re-evaluated in the next step.
+  std::vector<int> frontier_;
+  // Vertices that flipped in the current step.
+  std::vector<int> flipped_;
+  // Bitmap of vertices already in 'frontier_'.
+  State queued_;
+
+  // Recompute live-neighbor counts and put every vertex on the frontier.
+  void InitIncremental() {
+    const std::vector<int>& offsets = Offsets();
+    const std::vector<int>& neighbors = Neighbors();
+    const int num_vertices = NumVertices();
+    live_count_.assign(num_vertices, 0);
+    frontier_.resize(num_vertices);
+    for (int i = 0; i < num_vertices; ++i) {
+      for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+        live_count_[i] += IsLive(neighbors[k]);
+      }
+      frontier_[i] = i;
+    }
+    queued_.assign(state_.size(), 0);
+    counts_valid_ = true;
+  }
+
+  void UpdateIncremental() {
+    if (!counts_valid_) InitIncremental();
+    const GTopology& topology = *topology_;
+    const std::vector<int>& offsets = topology.Offsets();
+    const std::vector<int>& neighbors = topology.Neighbors();
+
+    // Evaluate the rule on the frontier only; every other vertex has the
+    // same inputs as last time it was evaluated, and did not flip then.
+    GLIFE_PROFILE_COUNT(kCellsEvaluated, frontier_.size());
+    flipped_.clear();
+    for (int i : frontier_) {
+      const bool live = IsLive(i);
+      if (topology.NextState(live, topology.Degree(i), live_count_[i]) !=
+          live) {
+        flipped_.push_back(i);
+      }
+    }
+
+    // Apply the flips, and collect the next frontier.
+    for (int i : frontier_) queued_[i >> 6] &= ~(uint64_t{1} << (i & 63));
+    frontier_.clear();
+    auto enqueue = [this](int i) {
+      uint64_t& word = queued_[i >> 6];
+      const uint64_t bit = uint64_t{1} << (i & 63);
+      if ((word & bit) == 0) {
+        word |= bit;
+        frontier_.push_back(i);
+      }
+    };
+    for (int i : flipped_) {
+      state_[i >> 6] ^= uint64_t{1} << (i & 63);
+      const int delta = IsLive(i) ? 1 : -1;
+      enqueue(i);
+      for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+        const int j = neighbors[k];
+        live_count_[j] += delta;
+        enqueue(j);
+      }
+    }
   }
 
+  static int NumWords(int num_vertices) { return (num_vertices + 63) / 64; }
 };
 
 #endif //GLIFE_H_
@@ -0,0 +1,321 @@
+// Microbenchmarks of the simulation and analysis hot paths.
+//
+// Usage: ./glife_bench [--filter=substring] [--min_time=s] [--max_size=n]
+//                      [--output=results.json]
+//
+// Each benchmark repeats one operation (a generation, a whole
+// simulation, a load) for at least --min_time seconds and reports the
+// time per operation, cell updates per second where that applies, and
+// the bytes and blocks allocated per operation. A table goes to stdout;
+// --output also writes the results as JSON, for comparing runs.
+// "make bench" builds with optimization and writes bench.json.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "brent.h"
+#include "entropy.h"
+#include "ggen.h"
+#include "glife.h"
+#include "rng.h"
+#include "rules.h"
+#include "simulate.h"
+
+ABSL_FLAG(std::string, filter, "",
+          "Only run benchmarks whose name contains this");
+ABSL_FLAG(double, min_time, 0.5, "Minimum seconds to run each benchmark");
+ABSL_FLAG(int, max_size, 4096, "Largest torus side to benchmark");
+ABSL_FLAG(std::string, output, "", "Write the results to this JSON file");
+
+// Every allocation goes through these, so a benchmark can tell how much
+// its operation allocates. Profiling builds count them in profile.h.
+#ifdef GLIFE_PROFILE
+int64_t AllocatedBytes() { return profile::Total(profile::kBytesAllocated); }
+int64_t AllocatedBlocks() { return profile::Total(profile::kAllocations); }
+#else
+static std::atomic<int64_t> allocated_bytes{0};
+static std::atomic<int64_t> allocated_blocks{0};
+
+int64_t AllocatedBytes() { return allocated_bytes; }
+int64_t AllocatedBlocks() { return allocated_blocks; }
+
+void* operator new(size_t size) {
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  allocated_blocks.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#endif
+
+struct BenchResult {
+  std::string name;
+  int64_t iterations = 0;
+  double ns_per_op = 0;
+  // Zero when the operation is not a number of cell updates.
+  double cell_updates_per_second = 0;
+  double bytes_per_op = 0;
+  double allocs_per_op = 0;
+};
+
+std::vector<BenchResult> results;
+
+// Time 'op', which updates 'cells_per_op' cells, after one untimed run.
+void Bench(const std::string& name, int64_t cells_per_op,
+           const std::function<void()>& op) {
+  const std::string filter = absl::GetFlag(FLAGS_filter);
+  if (!filter.empty() && name.find(filter) == std::string::npos) return;
+  op();
+  const double min_time = absl::GetFlag(FLAGS_min_time);
+  const int64_t bytes = AllocatedBytes();
+  const int64_t blocks = AllocatedBlocks();
+  const auto start = std::chrono::steady_clock::now();
+  int64_t n = 0;
+  double elapsed = 0;
+  do {
+    op();
+    n += 1;
+    elapsed = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < min_time);
+
+  BenchResult r;
+  r.name = name;
+  r.iterations = n;
+  r.ns_per_op = 1e9 * elapsed / n;
+  r.cell_updates_per_second = cells_per_op * n / elapsed;
+  r.bytes_per_op = double(AllocatedBytes() - bytes) / n;
+  r.allocs_per_op = double(AllocatedBlocks() - blocks) / n;
+  printf("%-48s %10lld %14.0f %12.3g %12.1f %8.1f\n", r.name.c_str(),
+         (long long)r.iterations, r.ns_per_op, r.cell_updates_per_second,
+         r.bytes_per_op, r.allocs_per_op);
+  fflush(stdout);
+  results.push_back(r);
+}
+
+void WriteResults(const std::string& filename) {
+  FILE* f = fopen(filename.c_str(), "w");
+  if (f == nullptr) {
+    perror(filename.c_str());
+    exit(1);
+  }
+  fprintf(f, "{\"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    fprintf(f,
+            "  {\"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.1f, "
+            "\"cell_updates_per_second\": %.6g, \"bytes_per_op\": %.1f, "
+            "\"allocs_per_op\": %.2f}%s\n",
+            r.name.c_str(), (long long)r.iterations, r.ns_per_op,
+            r.cell_updates_per_second, r.bytes_per_op, r.allocs_per_op,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "]}\n");
+  fclose(f);
+}
+
+// A random state with each vertex live with probability 'density'.
+GLife::State RandomState(int num_vertices, double density, uint64_t seed) {
+  Rng rng(seed, 0);
+  GLife::State state((num_vertices + 63) / 64);
+  for (int v = 0; v < num_vertices; ++v) {
+    if (rng.Unit() < density) state[v >> 6] |= uint64_t{1} << (v & 63);
+  }
+  return state;
+}
+
+// The n x n torus, simulated by the torus kernel or by the general CSR
+// code.
+GLife Torus(int n, bool kernel) {
+  CSRGraph g = GenerateTorus(n, n, Neighborhood::kMoore,
+                             std::thread::hardware_concurrency());
+  if (!kernel) g.torus_size = 0;
+  return GLife(std::move(g));
+}
+
+void BenchUpdate(const std::string& name, GLife& glife, double density) {
+  const GLife::State start = RandomState(glife.NumVertices(), density, 1);
+  glife.SetState(start);
+  int steps = 0;
+  Bench(name, glife.NumVertices(), [&] {
+    // Restart now and then, so the benchmark does not end up timing a
+    // dead or settled graph.
+    if (++steps % 64 == 0) glife.SetState(start);
+    glife.Update();
+  });
+}
+
+RuleFn Rule(const std::string& spec) {
+  RuleFn fn;
+  if (!ParseRule(spec, &fn)) abort();
+  return fn;
+}
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  const int max_size = absl::GetFlag(FLAGS_max_size);
+  printf("%-48s %10s %14s %12s %12s %8s\n", "benchmark", "iterations",
+         "ns/op", "cells/s", "bytes/op", "allocs/op");
+
+  // Update() by engine and torus size.
+  for (int n = 32; n <= max_size; n *= 2) {
+    for (const bool kernel : {true, false}) {
+      GLife glife = Torus(n, kernel);
+      BenchUpdate(absl::StrCat("update/", kernel ? "kernel" : "csr", "/life/",
+                               n, "/0.5"),
+                  glife, 0.5);
+    }
+  }
+
+  // By live density, where the incremental mode gains most.
+  const int n = std::min(512, max_size);
+  for (const double density : {0.05, 0.2, 0.5}) {
+    for (const char* engine : {"kernel", "csr", "incremental"}) {
+      GLife glife = Torus(n, engine == std::string("kernel"));
+      glife.SetIncremental(engine == std::string("incremental"));
+      BenchUpdate(absl::StrCat("update/", engine, "/life/", n, "/", density),
+                  glife, density);
+    }
+  }
+
+  // By rule. All rules compile to the same table lookups or, on the
+  // kernel, the same boolean logic, so these should match.
+  for (const char* rule : {"B36/S23", "density 0.4", "overpopulation 3 5"}) {
+    for (const bool kernel : {true, false}) {
+      GLife glife = Torus(n, kernel);
+      glife.SetNewStateFn(Rule(rule));
+      const std::string name =
+          absl::StrReplaceAll(rule, {{" ", "_"}, {"/", "_"}});
+      BenchUpdate(absl::StrCat("update/", kernel ? "kernel/" : "csr/", name,
+                               "/", n, "/0.5"),
+                  glife, 0.5);
+    }
+  }
+
+  // Rewired tori: the same degrees, less locality, and how much of it
+  // renumbering the vertices wins back.
+  for (const double fraction : {0.01, 0.1, 1.0}) {
+    for (const char* reorder : {"", "bfs", "rcm", "hilbert"}) {
+      GLife glife = Torus(n, false);
+      SeedThreadRng(1);
+      glife.ReWire(fraction * glife.Neighbors().size() / 2);
+      VertexOrder order;
+      if (*reorder != '\0' &&
+          (!ParseVertexOrder(reorder, &order) || !glife.Reorder(order))) {
+        abort();
+      }
+      BenchUpdate(absl::StrCat("update/csr/life/", n, "/0.5/rewired_",
+                               fraction, *reorder ? "/" : "", reorder),
+                  glife, 0.5);
+    }
+  }
+  {
+    GLife glife = Torus(n, false);
+    SeedThreadRng(1);
+    glife.ReWire(glife.Neighbors().size() / 2);
+    Bench(absl::StrCat("reorder/rcm/", n), glife.NumVertices(), [&] {
+      GLife copy(glife);
+      copy.Reorder(VertexOrder::kRCM);
+    });
+  }
+
+  // Analysis.
+  {
+    GLife glife = Torus(n, true);
+    glife.SetState(RandomState(glife.NumVertices(), 0.5, 1));
+    Bench(absl::StrCat("get_state_str/", n), 0,
+          [&] { glife.GetStateStr(); });
+
+    std::vector<std::string> states;
+    for (int i = 0; i < 100; ++i) {
+      states.push_back(glife.GetStateStr());
+      glife.Update();
+    }
+    Bench(absl::StrCat("shannon_entropy/", n, "/100_states"), 0,
+          [&] { ShannonEntropy(states.begin(), states.end()); });
+
+    EntropyAccumulator entropy(glife.NumVertices());
+    Bench(absl::StrCat("entropy_accumulator_add/", n), 0,
+          [&] { entropy.Add(glife.GetState()); });
+  }
+
+  // Whole simulations to a cycle, by cycle detection method. Small tori
+  // from random states settle in a few hundred steps.
+  for (const bool brent : {false, true}) {
+    GLife zygote = Torus(32, false);
+    SimOptions options;
+    options.brent = brent;
+    uint64_t seed = 0;
+    // Steps vary from state to state; report the time only.
+    Bench(absl::StrCat("simulate/", brent ? "brent" : "table", "/32"), 0, [&] {
+      GLife glife(zygote);
+      glife.SetState(RandomState(glife.NumVertices(), 0.5, ++seed));
+      Simulate(glife, options);
+    });
+  }
+  {
+    // Hashlife, with its memo carried over from state to state.
+    GLife zygote = Torus(32, true);
+    SimOptions options;
+    options.hashlife = true;
+    uint64_t seed = 0;
+    Bench("simulate/hashlife/32", 0, [&] {
+      GLife glife(zygote);
+      glife.SetState(RandomState(glife.NumVertices(), 0.5, ++seed));
+      Simulate(glife, options);
+    });
+  }
+  {
+    GLife zygote = Torus(32, false);
+    uint64_t seed = 0;
+    Bench("find_cycle_brent/32", 0, [&] {
+      GLife glife(zygote);
+      glife.SetState(RandomState(glife.NumVertices(), 0.5, ++seed));
+      FindCycleBrent(glife, 4000);
+    });
+  }
+
+  // Graph I/O.
+  {
+    char dir[] = "/tmp/glife_bench.XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+      perror("mkdtemp");
+      return 1;
+    }
+    const int io_n = std::min(256, max_size);
+    GLife glife = Torus(io_n, true);
+    glife.SetState(RandomState(glife.NumVertices(), 0.5, 1));
+    const std::string json = absl::StrCat(dir, "/torus.json");
+    const std::string bin = absl::StrCat(dir, "/torus.bin");
+    Bench(absl::StrCat("dump_json/", io_n), 0,
+          [&] { glife.DumpToJSON(json); });
+    Bench(absl::StrCat("dump_json/compact/", io_n), 0,
+          [&] { glife.DumpToJSON(json, true); });
+    glife.DumpToJSON(json);
+    glife.SaveBinary(bin);
+    GLife::SetBinaryCache(false);
+    Bench(absl::StrCat("load_json/", io_n), 0, [&] { GLife loaded(json); });
+    Bench(absl::StrCat("load_binary/", io_n), 0, [&] { GLife loaded(bin); });
+    unlink(json.c_str());
+    unlink(bin.c_str());
+    rmdir(dir);
+  }
+
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (!output.empty()) WriteResults(output);
+  return 0;
+}
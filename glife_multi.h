@@ -0,0 +1,359 @@
+#ifndef GLIFE_MULTI_H_
+#define GLIFE_MULTI_H_
+
+// Up to 64 independent trials on the same graph and rule, advanced in
+// lockstep. Bit l of every per-vertex word belongs to trial ("lane") l,
+// so walking the topology once advances all of them: neighbor counts
+// are summed with bit-sliced adders and the rule is applied as boolean
+// logic on the count bit planes.
+//
+// Each lane runs the same analysis as OneSimulationBrent() in shannon2:
+// Brent's algorithm finds the cycle length, a second pass finds the
+// transient, and one more lap around the cycle counts live cells for the
+// entropy. Lanes finish independently and can be refilled right away.
+
+#include <array>
+#include <assert.h>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "entropy.h"
+#include "glife.h"
+
+class GLifeMulti {
+ public:
+  static constexpr int kLanes = 64;
+
+  struct Result {
+    // As passed to Start().
+    int64_t id = -1;
+    // Index of the first repeated state, or max_steps if there is none.
+    int max_steps = 0;
+    int cycle_len = -1;
+    double entropy = 0.0;
+  };
+
+  // Simulates on the topology and rule of 'graph'.
+  GLifeMulti(const GLife& graph, int max_steps)
+      : num_vertices_(graph.NumVertices()), max_steps_(max_steps),
+        topology_(graph.Topology()), offsets_(topology_->Offsets()),
+        neighbors_(topology_->Neighbors()) {
+    int max_degree = 0;
+    for (int i = 0; i < num_vertices_; ++i) {
+      max_degree = std::max(max_degree, graph.Degree(i));
+    }
+    sum_planes_ = BitWidth(max_degree);
+    rules_.resize(max_degree + 1);
+    for (int d = 0; d <= max_degree; ++d) {
+      for (int n = 0; n <= d; ++n) {
+        const bool born = graph.NewStateFn()(false, d, n);
+        const bool stay = graph.NewStateFn()(true, d, n);
+        if (born || stay) rules_[d].push_back({n, born, stay});
+      }
+    }
+    count_planes_ = BitWidth(max_steps);
+    for (auto* bank : {&cur_, &next_, &tortoise_, &hare_, &hare_next_,
+                       &start_}) {
+      bank->resize(num_vertices_);
+    }
+    counts_.resize(size_t(num_vertices_) * count_planes_);
+  }
+
+  bool HasFreeLane() const { return ~active_ != 0; }
+  bool Idle() const { return active_ == 0; }
+
+  // Start a trial from 'state' ('1' for a live vertex) in a free lane.
+  void Start(int64_t id, const std::string& state) {
+    assert(state.size() == num_vertices_);
+    GLife::State words((num_vertices_ + 63) / 64);
+    for (int v = 0; v < num_vertices_; ++v) {
+      if (state[v] == '1') words[v >> 6] |= uint64_t{1} << (v & 63);
+    }
+    Start(id, words.data());
+  }
+
+  // Start a trial from a state given as words laid out as a GLife::State,
+  // in the numbering of the graph as loaded (see GLife::SetState()).
+  void Start(int64_t id, const uint64_t* state) {
+    assert(HasFreeLane());
+    const int l = __builtin_ctzll(~active_);
+    const uint64_t bit = uint64_t{1} << l;
+    for (int v = 0; v < num_vertices_; ++v) {
+      const uint64_t live = ((state[v >> 6] >> (v & 63)) & 1) << l;
+      const int i = topology_->Internal(v);
+      start_[i] = (start_[i] & ~bit) | live;
+    }
+    CopyLanes(start_, &cur_, bit);
+    CopyLanes(start_, &tortoise_, bit);
+    ClearCounts(bit);
+    lanes_[l] = Lane{id, kFindLength};
+    active_ |= bit;
+  }
+
+  // Advance every running trial by one step. Trials that are done are
+  // appended to 'done' and their lanes become free.
+  void Step(std::vector<Result>* done) {
+    GLIFE_PROFILE_SCOPE(kMultiTrialStep);
+    GLIFE_PROFILE_COUNT(kSteps, __builtin_popcountll(active_));
+    GLIFE_PROFILE_COUNT(kCellsEvaluated, 64 * offsets_.size() - 64);
+    uint64_t count = 0;
+    uint64_t rewind = 0;
+    uint64_t find_length = 0;
+    uint64_t find_start = 0;
+    for (uint64_t m = active_; m != 0; m &= m - 1) {
+      const int l = __builtin_ctzll(m);
+      const Lane& lane = lanes_[l];
+      const uint64_t bit = uint64_t{1} << l;
+      if (lane.phase == kFindLength) {
+        find_length |= bit;
+        if (lane.steps < max_steps_) count |= bit;
+      }
+      if (lane.phase == kRewind) rewind |= bit;
+      if (lane.phase == kFindStart) find_start |= bit;
+      if (lane.phase == kCountCycle) count |= bit;
+    }
+
+    // Count the current states, then advance.
+    if (count != 0) AddCounts(count);
+    Advance(cur_, &next_);
+    for (int v = 0; rewind != 0 && v < num_vertices_; ++v) {
+      next_[v] = (next_[v] & ~rewind) | (cur_[v] & rewind);
+    }
+    cur_.swap(next_);
+    if ((rewind | find_start) != 0) {
+      Advance(hare_, &hare_next_);
+      hare_.swap(hare_next_);
+    }
+
+    // Lanes whose current state differs from the tortoise or the hare.
+    uint64_t differs_tortoise = 0;
+    uint64_t differs_hare = 0;
+    for (int v = 0; find_length != 0 && v < num_vertices_; ++v) {
+      differs_tortoise |= cur_[v] ^ tortoise_[v];
+    }
+    for (int v = 0; (rewind | find_start) != 0 && v < num_vertices_; ++v) {
+      differs_hare |= cur_[v] ^ hare_[v];
+    }
+
+    uint64_t move_tortoise = 0;
+    uint64_t start_over = 0;
+    uint64_t start_counting = 0;
+    for (uint64_t m = active_; m != 0; m &= m - 1) {
+      const int l = __builtin_ctzll(m);
+      Lane& lane = lanes_[l];
+      const uint64_t bit = uint64_t{1} << l;
+      switch (lane.phase) {
+        case kFindLength:
+          lane.steps += 1;
+          lane.lambda += 1;
+          if ((differs_tortoise & bit) == 0) {
+            if (lane.lambda >= max_steps_) {
+              Finish(l, /*cycle=*/false, done);
+            } else {
+              // Rewind to the start and run the hare 'lambda' steps ahead.
+              lane.phase = kRewind;
+              lane.remaining = lane.lambda;
+              start_over |= bit;
+            }
+          } else if (lane.steps == max_steps_ - 1 ||
+                     lane.power == lane.lambda) {
+            // See FindCycleBrent() for the move at state max_steps - 1.
+            if (lane.steps > max_steps_ - 1) {
+              Finish(l, /*cycle=*/false, done);
+            } else {
+              move_tortoise |= bit;
+              lane.power =
+                  lane.steps == max_steps_ - 1 ? max_steps_ : 2 * lane.power;
+              lane.lambda = 0;
+            }
+          }
+          break;
+        case kRewind:
+          lane.remaining -= 1;
+          if (lane.remaining > 0) break;
+          lane.phase = kFindStart;
+          lane.mu = 0;
+          CheckStart(l, differs_hare, &start_counting, done);
+          break;
+        case kFindStart:
+          lane.mu += 1;
+          CheckStart(l, differs_hare, &start_counting, done);
+          break;
+        case kCountCycle:
+          lane.remaining -= 1;
+          if (lane.remaining == 0) Finish(l, /*cycle=*/true, done);
+          break;
+      }
+    }
+    if (move_tortoise != 0) CopyLanes(cur_, &tortoise_, move_tortoise);
+    if (start_over != 0) {
+      CopyLanes(start_, &cur_, start_over);
+      CopyLanes(start_, &hare_, start_over);
+    }
+    if (start_counting != 0) ClearCounts(start_counting);
+  }
+
+ private:
+  enum Phase : uint8_t {
+    // Brent's search for the cycle length.
+    kFindLength,
+    // The tortoise waits at the start while the hare gets 'lambda' ahead.
+    kRewind,
+    // Both advance until they meet at the start of the cycle.
+    kFindStart,
+    // One more lap around the cycle, counting live vertices.
+    kCountCycle,
+  };
+
+  struct Lane {
+    int64_t id = -1;
+    Phase phase = kFindLength;
+    // States the hare has advanced in kFindLength.
+    long steps = 0;
+    long power = 1;
+    int lambda = 0;
+    int mu = 0;
+    // Steps left in kRewind and kCountCycle.
+    int remaining = 0;
+  };
+
+  struct RuleTerm {
+    int count;
+    bool born;
+    bool stay;
+  };
+
+  const int num_vertices_;
+  const int max_steps_;
+  // Shared with 'graph', not copied.
+  const std::shared_ptr<const GTopology> topology_;
+  const std::vector<int>& offsets_;
+  const std::vector<int>& neighbors_;
+  // For each degree, the live neighbor counts for which a dead vertex
+  // is born or a live one stays alive.
+  std::vector<std::vector<RuleTerm>> rules_;
+  // Bit planes needed for a neighbor count.
+  int sum_planes_ = 0;
+
+  // One word per vertex, one bit per lane.
+  std::vector<uint64_t> cur_;
+  std::vector<uint64_t> next_;
+  std::vector<uint64_t> tortoise_;
+  std::vector<uint64_t> hare_;
+  std::vector<uint64_t> hare_next_;
+  std::vector<uint64_t> start_;
+  // Bit-sliced per-vertex live counts: bit p of the count of vertex v
+  // is in counts_[v * count_planes_ + p].
+  std::vector<uint64_t> counts_;
+  int count_planes_ = 0;
+
+  std::array<Lane, kLanes> lanes_;
+  uint64_t active_ = 0;
+
+  static int BitWidth(int n) {
+    int width = 1;
+    while ((n >> width) != 0) width += 1;
+    return width;
+  }
+
+  // One generation of every lane of 'in'.
+  void Advance(const std::vector<uint64_t>& in,
+               std::vector<uint64_t>* out) const {
+    uint64_t sum[32];
+    for (int v = 0; v < num_vertices_; ++v) {
+      for (int q = 0; q < sum_planes_; ++q) sum[q] = 0;
+      for (int k = offsets_[v]; k < offsets_[v + 1]; ++k) {
+        uint64_t carry = in[neighbors_[k]];
+        for (int q = 0; q < sum_planes_ && carry != 0; ++q) {
+          const uint64_t t = sum[q] & carry;
+          sum[q] ^= carry;
+          carry = t;
+        }
+      }
+      uint64_t born = 0;
+      uint64_t stay = 0;
+      for (const RuleTerm& term : rules_[offsets_[v + 1] - offsets_[v]]) {
+        uint64_t match = ~uint64_t{0};
+        for (int q = 0; q < sum_planes_; ++q) {
+          match &= ((term.count >> q) & 1) ? sum[q] : ~sum[q];
+        }
+        if (term.born) born |= match;
+        if (term.stay) stay |= match;
+      }
+      (*out)[v] = (in[v] & stay) | (~in[v] & born);
+    }
+  }
+
+  static void CopyLanes(const std::vector<uint64_t>& from,
+                        std::vector<uint64_t>* to, uint64_t lanes) {
+    for (int v = 0; v < from.size(); ++v) {
+      (*to)[v] = ((*to)[v] & ~lanes) | (from[v] & lanes);
+    }
+  }
+
+  // Add the current state of 'lanes' to their live counts.
+  void AddCounts(uint64_t lanes) {
+    for (int v = 0; v < num_vertices_; ++v) {
+      uint64_t* planes = &counts_[size_t(v) * count_planes_];
+      uint64_t carry = cur_[v] & lanes;
+      for (int p = 0; p < count_planes_ && carry != 0; ++p) {
+        const uint64_t t = planes[p] & carry;
+        planes[p] ^= carry;
+        carry = t;
+      }
+    }
+  }
+
+  void ClearCounts(uint64_t lanes) {
+    for (uint64_t& w : counts_) w &= ~lanes;
+  }
+
+  // Summed in the numbering of the graph as loaded, as by
+  // EntropyAccumulator.
+  double LaneEntropy(int l, int num_states) const {
+    std::vector<int> v(num_vertices_);
+    for (int i = 0; i < num_vertices_; ++i) {
+      const uint64_t* planes = &counts_[size_t(i) * count_planes_];
+      int& count = v[topology_->Original(i)];
+      for (int p = 0; p < count_planes_; ++p) {
+        count |= ((planes[p] >> l) & 1) << p;
+      }
+    }
+    return EntropyFromCounts(v, num_states);
+  }
+
+  // In kFindStart: done if the tortoise met the hare, or gave up.
+  void CheckStart(int l, uint64_t differs_hare, uint64_t* start_counting,
+                  std::vector<Result>* done) {
+    Lane& lane = lanes_[l];
+    if (lane.mu + lane.lambda >= max_steps_) {
+      Finish(l, /*cycle=*/false, done);
+    } else if ((differs_hare & (uint64_t{1} << l)) == 0) {
+      lane.phase = kCountCycle;
+      lane.remaining = lane.lambda;
+      *start_counting |= uint64_t{1} << l;
+    }
+  }
+
+  void Finish(int l, bool cycle, std::vector<Result>* done) {
+    const Lane& lane = lanes_[l];
+    Result result;
+    result.id = lane.id;
+    if (cycle) {
+      result.max_steps = lane.mu + lane.lambda;
+      result.cycle_len = lane.lambda;
+      result.entropy = LaneEntropy(l, lane.lambda);
+    } else {
+      // The counts still hold the first max_steps states from
+      // kFindLength, which ran at least that far.
+      result.max_steps = max_steps_;
+      result.entropy = LaneEntropy(l, max_steps_);
+    }
+    done->push_back(result);
+    active_ &= ~(uint64_t{1} << l);
+  }
+};
+
+#endif  // GLIFE_MULTI_H_
@@ -0,0 +1,28 @@
+// Convert a graph from JSON to the binary graph format, which loads
+// without parsing. GLife reads either format.
+//
+// Usage: ./graph2bin in.json out.bin
+//
+
+#include <iostream>
+#include <string>
+
+#include "glife.h"
+
+void usage(const char *argv0)
+{
+  std::cerr << "Usage: " << argv0 << " in.json out.bin" << std::endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3) usage(argv[0]);
+  GLife::SetBinaryCache(false);
+  GLife glife(argv[1]);
+  if (!glife.SaveBinary(argv[2])) {
+    std::cerr << "Error: could not write " << argv[2] << std::endl;
+    return 1;
+  }
+  return 0;
+}
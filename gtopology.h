@@ -0,0 +1,310 @@
+#ifndef GTOPOLOGY_H_
+#define GTOPOLOGY_H_
+
+// The part of a GLife that stays fixed while it is simulated: the graph
+// in compressed sparse row form, the vertex names, and the rule, both as
+// given and tabulated, plus the bit-parallel kernel when the graph is a
+// GTorus.
+//
+// Copies of a GLife share one GTopology and only copy it when one of
+// them edits the graph or the rule. A shared GTopology is never modified
+// and its rule is always compiled, so any number of threads can read it.
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtorus_kernel.h"
+
+class GTopology {
+ public:
+  // Classical Conway rules
+  static bool NewStateConway(bool current_state, int num_neighbors,
+                             int num_live_neighbors) {
+    if (num_live_neighbors < 2) return false;
+    if (num_live_neighbors == 2) return current_state;
+    if (num_live_neighbors == 3) return true;
+    return false;
+  }
+
+  GTopology() { CompileRule(); }
+
+  int NumVertices() const { return offsets_.size() - 1; }
+  int Degree(int i) const { return offsets_[i + 1] - offsets_[i]; }
+
+  // The neighbors of vertex i are Neighbors()[k] for k in
+  // [Offsets()[i], Offsets()[i + 1]), sorted.
+  const std::vector<int>& Offsets() const { return offsets_; }
+  const std::vector<int>& Neighbors() const { return neighbors_; }
+
+  // True if 'a' and 'b' are connected.
+  bool HasEdge(int a, int b) const {
+    const int* begin = neighbors_.data() + offsets_[a];
+    const int* end = neighbors_.data() + offsets_[a + 1];
+    return std::binary_search(begin, end, b);
+  }
+
+  const std::vector<std::string>& VertexNames() const { return vertex_names_; }
+
+  // After Permute(), vertices are numbered differently from the graph
+  // as loaded: vertex i here is vertex OriginalIndex()[i] there, and
+  // InternalIndex() is the inverse. Both are empty if never permuted.
+  const std::vector<int>& OriginalIndex() const { return original_; }
+  const std::vector<int>& InternalIndex() const { return internal_; }
+  int Original(int i) const { return original_.empty() ? i : original_[i]; }
+  int Internal(int v) const { return internal_.empty() ? v : internal_[v]; }
+
+  // Set when the graph is an unmodified GTorus, see IsTorus().
+  const std::optional<GTorusKernel>& Torus() const { return torus_; }
+
+  const std::function<bool(bool, int, int)>& NewStateFn() const {
+    return new_state_fn_;
+  }
+
+  // The rule, looked up in the table compiled from NewStateFn().
+  bool NextState(bool live, int degree, int num_live) const {
+    return rule_table_[(degree * (max_degree_ + 1) + num_live) * 2 + live];
+  }
+
+  // Every arc of the graph as a (source, target) pair.
+  std::vector<std::pair<int, int>> Arcs() const {
+    std::vector<std::pair<int, int>> arcs;
+    arcs.reserve(neighbors_.size());
+    for (int i = 0; i < NumVertices(); ++i) {
+      for (int k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+        arcs.emplace_back(i, neighbors_[k]);
+      }
+    }
+    return arcs;
+  }
+
+  // True if this is the n x n torus built by GTorus: vertex i + n * j is
+  // named "i_j" and is connected to its 8 surrounding cells.
+  bool IsTorus(int n) const {
+    if (n < 3 || NumVertices() != n * n) return false;
+    for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < n; ++i) {
+        const int index = i + n * j;
+        if (vertex_names_[index] !=
+            std::to_string(i) + "_" + std::to_string(j)) {
+          return false;
+        }
+        if (Degree(index) != 8) return false;
+        for (int di = -1; di <= 1; ++di) {
+          for (int dj = -1; dj <= 1; ++dj) {
+            if (di == 0 && dj == 0) continue;
+            const int other = (i + n + di) % n + n * ((j + n + dj) % n);
+            if (!HasEdge(index, other)) return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  // The methods below modify the topology, and must only be called on
+  // one that is not shared (see GLife::MutableTopology()).
+
+  // 'fn' must be a pure function of its arguments: it is tabulated for
+  // every (current state, degree, live neighbor count) combination that
+  // can occur in this graph.
+  void SetNewStateFn(std::function<bool(bool, int, int)> fn) {
+    new_state_fn_ = std::move(fn);
+    CompileRule();
+  }
+
+  void SetVertexNames(std::vector<std::string> names) {
+    vertex_names_ = std::move(names);
+  }
+
+  // Take over CSR arrays with sorted rows.
+  void SetCSR(std::vector<int> offsets, std::vector<int> neighbors) {
+    offsets_ = std::move(offsets);
+    neighbors_ = std::move(neighbors);
+    TopologyChanged();
+  }
+
+  // (Re)build the CSR arrays from a list of directed arcs.
+  // Duplicate arcs are dropped.
+  void BuildCSR(int num_vertices, const std::vector<std::pair<int, int>>& arcs) {
+    offsets_.assign(num_vertices + 1, 0);
+    for (const auto& [s, t] : arcs) offsets_[s + 1] += 1;
+    for (int i = 0; i < num_vertices; ++i) offsets_[i + 1] += offsets_[i];
+    neighbors_.resize(arcs.size());
+    std::vector<int> fill(offsets_.begin(), offsets_.end() - 1);
+    for (const auto& [s, t] : arcs) neighbors_[fill[s]++] = t;
+    // Sort each row and squeeze out duplicates.
+    int out = 0;
+    for (int i = 0; i < num_vertices; ++i) {
+      const auto begin = neighbors_.begin() + offsets_[i];
+      const auto end = neighbors_.begin() + offsets_[i + 1];
+      std::sort(begin, end);
+      const auto last = std::unique(begin, end);
+      offsets_[i] = out;
+      out = std::copy(begin, last, neighbors_.begin() + out) - neighbors_.begin();
+    }
+    offsets_[num_vertices] = out;
+    neighbors_.resize(out);
+    neighbors_.shrink_to_fit();
+    TopologyChanged();
+  }
+
+  // Renumber the vertices so that vertex 'order[k]' becomes vertex k;
+  // 'order' must be a permutation. Rows stay sorted, and the names and
+  // OriginalIndex() follow their vertices.
+  void Permute(const std::vector<int>& order) {
+    const int num_vertices = NumVertices();
+    assert(order.size() == num_vertices);
+    std::vector<int> new_of_old(num_vertices);
+    for (int k = 0; k < num_vertices; ++k) new_of_old[order[k]] = k;
+    std::vector<int> offsets(num_vertices + 1);
+    std::vector<int> neighbors(neighbors_.size());
+    std::vector<std::string> names(vertex_names_.size());
+    for (int k = 0; k < num_vertices; ++k) {
+      const int old = order[k];
+      int out = offsets[k];
+      for (int j = offsets_[old]; j < offsets_[old + 1]; ++j) {
+        neighbors[out++] = new_of_old[neighbors_[j]];
+      }
+      std::sort(neighbors.begin() + offsets[k], neighbors.begin() + out);
+      offsets[k + 1] = out;
+      if (!names.empty()) names[k] = std::move(vertex_names_[old]);
+    }
+    std::vector<int> original(num_vertices);
+    for (int k = 0; k < num_vertices; ++k) original[k] = Original(order[k]);
+    original_ = std::move(original);
+    internal_.resize(num_vertices);
+    bool identity = true;
+    for (int k = 0; k < num_vertices; ++k) {
+      internal_[original_[k]] = k;
+      identity = identity && original_[k] == k;
+    }
+    if (identity) {
+      original_.clear();
+      internal_.clear();
+    }
+    vertex_names_ = std::move(names);
+    SetCSR(std::move(offsets), std::move(neighbors));
+  }
+
+  // Simulate with the torus kernel; the graph must be the n x n torus.
+  void SetTorus(int n) {
+    torus_.emplace(n);
+    CompileRule();
+  }
+
+  // Add 'b' to the (sorted) row of 'a'.
+  void InsertNeighbor(int a, int b) {
+    const auto begin = neighbors_.begin() + offsets_[a];
+    const auto end = neighbors_.begin() + offsets_[a + 1];
+    neighbors_.insert(std::upper_bound(begin, end, b), b);
+    for (int i = a + 1; i < offsets_.size(); ++i) offsets_[i] += 1;
+    TopologyChanged();
+  }
+
+  // Remove 'b' from the row of 'a'.
+  void EraseNeighbor(int a, int b) {
+    const auto begin = neighbors_.begin() + offsets_[a];
+    const auto end = neighbors_.begin() + offsets_[a + 1];
+    const auto it = std::lower_bound(begin, end, b);
+    assert(it != end && *it == b);
+    neighbors_.erase(it);
+    for (int i = a + 1; i < offsets_.size(); ++i) offsets_[i] -= 1;
+    TopologyChanged();
+  }
+
+  // Replace neighbor 'old_b' of 'a' by 'new_b', keeping the row sorted.
+  // Degrees do not change, so neither do the rule table and ArcSources().
+  void ReplaceNeighbor(int a, int old_b, int new_b) {
+    const auto begin = neighbors_.begin() + offsets_[a];
+    const auto end = neighbors_.begin() + offsets_[a + 1];
+    const auto it = std::lower_bound(begin, end, old_b);
+    assert(it != end && *it == old_b);
+    assert(!std::binary_search(begin, end, new_b));
+    // Slide the entries between the old and new positions over by one.
+    if (new_b > old_b) {
+      const auto pos = std::lower_bound(it + 1, end, new_b);
+      std::copy(it + 1, pos, it);
+      *(pos - 1) = new_b;
+    } else {
+      const auto pos = std::lower_bound(begin, it, new_b);
+      std::copy_backward(pos, it, it + 1);
+      *pos = new_b;
+    }
+    torus_.reset();
+  }
+
+  // The source vertex of each arc, parallel to Neighbors(), so that an
+  // arc (and so an edge and its orientation) can be drawn uniformly in
+  // O(1). Built on first use and kept while degrees do not change, which
+  // rewiring guarantees.
+  const std::vector<int>& ArcSources() {
+    if (arc_source_.size() != neighbors_.size()) {
+      arc_source_.resize(neighbors_.size());
+      for (int i = 0; i < NumVertices(); ++i) {
+        std::fill(arc_source_.begin() + offsets_[i],
+                  arc_source_.begin() + offsets_[i + 1], i);
+      }
+    }
+    return arc_source_;
+  }
+
+ private:
+  std::function<bool(bool, int, int)> new_state_fn_ = NewStateConway;
+  std::vector<int> offsets_ = {0};
+  std::vector<int> neighbors_;
+  // Original vertex names.
+  std::vector<std::string> vertex_names_;
+  // See ArcSources().
+  std::vector<int> arc_source_;
+  // See OriginalIndex().
+  std::vector<int> original_;
+  std::vector<int> internal_;
+
+  // 'new_state_fn_' tabulated by CompileRule(): the entry for a vertex of
+  // degree d with n live neighbors and current state s is at
+  // (d * (max_degree_ + 1) + n) * 2 + s.
+  std::vector<uint8_t> rule_table_;
+  int max_degree_ = -1;
+
+  std::optional<GTorusKernel> torus_;
+
+  // After an edit that may change degrees.
+  void TopologyChanged() {
+    arc_source_.clear();
+    torus_.reset();
+    CompileRule();
+  }
+
+  void CompileRule() {
+    max_degree_ = 0;
+    for (int i = 0; i < NumVertices(); ++i) {
+      max_degree_ = std::max(max_degree_, Degree(i));
+    }
+    const int stride = max_degree_ + 1;
+    rule_table_.assign(2 * stride * stride, 0);
+    for (int d = 0; d <= max_degree_; ++d) {
+      for (int n = 0; n <= d; ++n) {
+        for (int s = 0; s < 2; ++s) {
+          rule_table_[(d * stride + n) * 2 + s] = new_state_fn_(s, d, n);
+        }
+      }
+    }
+    if (torus_) {
+      uint16_t birth = 0, survive = 0;
+      for (int n = 0; n <= 8; ++n) {
+        birth |= NextState(false, 8, n) << n;
+        survive |= NextState(true, 8, n) << n;
+      }
+      torus_->SetRule(birth, survive);
+    }
+  }
+};
+
+#endif  // GTOPOLOGY_H_
@@ -11,6 +11,8 @@
 #include <vector>
 #include <math.h>
 
+#include "json_writer.h"
+
 using std::ofstream;
 using std::endl;
 
@@ -49,50 +51,34 @@ class GTorus{
 
   // 'filename' contains the specification of the generated graph, 
   // including its state in JSON format 
-  void DumpToJSON(const std::string& filename) {
-
-    ofstream outjson;
-    outjson.open(filename);
-    outjson << "{" << endl;
-    outjson << "\"name\" : \"Torus\"," << endl;
-    outjson << "\"size\" : " << sqrt(adjacency_.size()) << "," << endl;
-    outjson << "\"vertices\" : [" << endl;
+  // With 'compact', each undirected edge is written once.
+  void DumpToJSON(const std::string& filename, bool compact = false) {
+    GraphJSONWriter out(filename);
+    out.Field("name", "Torus");
+    out.Field("size", lround(sqrt(adjacency_.size())));
+    out.BeginVertices();
     for (int index = 0; index < adjacency_.size(); ++index) {
-      outjson << "{ \"name\" : \"" << vertex_names_[index] << "\"";
-      bool live = state_.find(index) != state_.end();
-      if (live) {
-        outjson << ", \"state\" : true ";
-      }
-       
-      outjson << "}";
-      if (index < adjacency_.size() - 1)
-        outjson << ",";
-      outjson << endl;
+      out.Vertex(vertex_names_[index], state_.find(index) != state_.end());
     }
-    outjson << "]," << endl; // end of vertices
-    outjson << "\"edges\" : [" << endl;
+    out.BeginEdges();
     for (int index = 0; index < adjacency_.size(); ++index) {
-      const std::set<int>& neighbors = adjacency_[index]; 
-      int i = 0;
-      for (int j : neighbors) {
-        outjson << "{ \"s\" : \"" << vertex_names_[index] << "\","
-                << " \"t\" : \"" << vertex_names_[j] << "\" }";
-        if (!(index == adjacency_.size() - 1 && i == neighbors.size() - 1))
-          outjson << ",";
-        outjson << endl;
-        i++;
-      } 
+      for (int j : adjacency_[index]) {
+        if (compact && j < index) continue;
+        out.Edge(vertex_names_[index], vertex_names_[j]);
+      }
     }
-    outjson << "]," << endl; // end of edges
+    out.EndEdges(/*more=*/true);
     // empty result; populated at end of simulation
-    outjson << "\"result\" : {" << endl;
-    outjson << "\"states\" : []," << endl;
-    outjson << "\"steps\" : " << 0 << "," << endl;
-    outjson << "\"finite_path\" : " << 0 << "," << endl;
-    outjson << "\"cycle_length\" : " << 0 << endl;
-    outjson << "}" << endl; // end of result
-    outjson << "}" << endl;
-    outjson.close();
+    out.Raw("\"result\" : {\n"
+            "\"states\" : [],\n"
+            "\"steps\" : 0,\n"
+            "\"finite_path\" : 0,\n"
+            "\"cycle_length\" : 0\n"
+            "}\n"  // end of result
+            "}\n");
+    if (!out.Close()) {
+      std::cerr << "Error: could not write " << filename << std::endl;
+    }
   }
 
   // Add vertex 'i' to the live vertices. 
@@ -0,0 +1,215 @@
+#ifndef GTORUS_KERNEL_H_
+#define GTORUS_KERNEL_H_
+
+// Bit-parallel Life on an n x n torus with 8 neighbors per cell, as
+// generated by GTorus. Cell (i, j) is vertex i + n * j, so row j is the
+// n consecutive bits starting at bit n * j of a packed state.
+//
+// Each row is kept in W = ceil(n / 64) words; the 8 neighbor bits of 64
+// cells are summed at once with a bit-sliced adder tree and the rule is
+// applied as boolean logic on the 4 bit planes of the sum.
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <numeric>
+#include <vector>
+
+// Build the row loop for AVX-512 and AVX2 as well, and pick the best
+// one at load time.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define GTORUS_KERNEL_CLONES \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define GTORUS_KERNEL_CLONES
+#endif
+
+class GTorusKernel {
+ public:
+  explicit GTorusKernel(int n)
+      : n_(n), words_per_row_((n + 63) / 64),
+        tail_mask_(n % 64 == 0 ? ~uint64_t{0}
+                               : (uint64_t{1} << (n % 64)) - 1) {
+    assert(n >= 3);
+  }
+
+  // Working buffers of Step(), one per simulation in progress, so that
+  // one kernel can step many states at once.
+  struct Scratch {
+    // Padded copies of the rows, when n is not a multiple of 64.
+    std::vector<uint64_t> cur;
+    std::vector<uint64_t> next;
+    // Each row rotated by one cell in either direction.
+    std::vector<uint64_t> left;
+    std::vector<uint64_t> right;
+  };
+
+  int size() const { return n_; }
+  uint16_t birth() const { return birth_; }
+  uint16_t survive() const { return survive_; }
+
+  // Bit k of 'birth' ('survive') is set if a dead (live) cell with
+  // k live neighbors is live in the next generation.
+  void SetRule(uint16_t birth, uint16_t survive) {
+    birth_ = birth;
+    survive_ = survive;
+  }
+
+  // Advance the packed state 'in' (n * n bits) by one generation into
+  // 'out'. 'in' and 'out' must not overlap.
+  void Step(const uint64_t* in, uint64_t* out, Scratch* scratch) const {
+    StepRows(in, out, 0, n_, scratch);
+  }
+
+  // Step() for rows [j_begin, j_end) only, writing just their words of
+  // 'out', so that threads with scratches of their own can step disjoint
+  // row ranges at once. Both ends must be multiples of RowAlignment().
+  void StepRows(const uint64_t* in, uint64_t* out, int j_begin, int j_end,
+                Scratch* scratch) const {
+    assert(j_begin < j_end && j_begin % RowAlignment() == 0 &&
+           (j_end == n_ || j_end % RowAlignment() == 0));
+    // Local row k is row j_begin - 1 + k, wrapping around, so the rows
+    // above and below the range are k = 0 and k = count + 1.
+    const int count = j_end - j_begin;
+    const size_t size = Row(count + 2);
+    if (scratch->left.size() != size) {
+      if (!Aligned()) {
+        scratch->cur.resize(size);
+        scratch->next.resize(Row(count));
+      }
+      scratch->left.resize(size);
+      scratch->right.resize(size);
+    }
+    uint64_t* left = scratch->left.data();
+    uint64_t* right = scratch->right.data();
+    auto row = [&](int k) { return (j_begin - 1 + k + n_) % n_; };
+    auto cur = [&](int k) -> const uint64_t* {
+      return Aligned() ? in + Row(row(k)) : &scratch->cur[Row(k)];
+    };
+    for (int k = 0; k < count + 2; ++k) {
+      if (!Aligned()) {
+        // Rows do not start on word boundaries; copy them into padded
+        // rows.
+        ExtractRow(in, size_t(n_) * row(k), &scratch->cur[Row(k)]);
+      }
+      ShiftRow(cur(k), left + Row(k), right + Row(k));
+    }
+    for (int k = 1; k <= count; ++k) {
+      uint64_t* next =
+          Aligned() ? out + Row(row(k)) : &scratch->next[Row(k - 1)];
+      StepRow(cur(k - 1), left + Row(k - 1), right + Row(k - 1),
+              cur(k), left + Row(k), right + Row(k),
+              cur(k + 1), left + Row(k + 1), right + Row(k + 1),
+              next, words_per_row_, birth_, survive_);
+      next[words_per_row_ - 1] &= tail_mask_;
+    }
+    if (!Aligned()) {
+      const size_t begin = size_t(n_) * j_begin / 64;
+      const size_t end = (size_t(n_) * j_end + 63) / 64;
+      memset(out + begin, 0, sizeof(uint64_t) * (end - begin));
+      for (int k = 1; k <= count; ++k) {
+        InsertRow(&scratch->next[Row(k - 1)], out, size_t(n_) * row(k));
+      }
+    }
+  }
+
+  // Row ranges for StepRows() start at multiples of this, the smallest
+  // number of rows that fills whole words.
+  int RowAlignment() const { return 64 / std::gcd(n_, 64); }
+
+ private:
+  const int n_;
+  const int words_per_row_;
+  // Valid bits of the last word of a row.
+  const uint64_t tail_mask_;
+  uint16_t birth_ = 1 << 3;
+  uint16_t survive_ = (1 << 2) | (1 << 3);
+
+  // When n is a multiple of 64 rows are word aligned in the packed
+  // state itself, and no copying is needed.
+  bool Aligned() const { return n_ % 64 == 0; }
+  size_t Row(int j) const { return size_t(words_per_row_) * j; }
+
+  // Copy the n bits at bit offset 'pos' of 'in' to the padded 'row'.
+  void ExtractRow(const uint64_t* in, size_t pos, uint64_t* row) const {
+    const size_t end = (pos + n_ + 63) / 64;
+    for (int w = 0; w < words_per_row_; ++w) {
+      const size_t bit = pos + 64 * size_t(w);
+      const size_t word = bit / 64;
+      const int shift = bit % 64;
+      uint64_t v = in[word] >> shift;
+      if (shift != 0 && word + 1 < end) v |= in[word + 1] << (64 - shift);
+      row[w] = v;
+    }
+    row[words_per_row_ - 1] &= tail_mask_;
+  }
+
+  // OR the padded 'row' into 'out' at bit offset 'pos'.
+  void InsertRow(const uint64_t* row, uint64_t* out, size_t pos) const {
+    const size_t end = (pos + n_ + 63) / 64;
+    for (int w = 0; w < words_per_row_; ++w) {
+      const size_t bit = pos + 64 * size_t(w);
+      const size_t word = bit / 64;
+      const int shift = bit % 64;
+      out[word] |= row[w] << shift;
+      if (shift != 0 && word + 1 < end) out[word + 1] |= row[w] >> (64 - shift);
+    }
+  }
+
+  // left[i] = row[i - 1] and right[i] = row[i + 1], wrapping around.
+  void ShiftRow(const uint64_t* row, uint64_t* left, uint64_t* right) const {
+    const int last = words_per_row_ - 1;
+    const int top = (n_ - 1) % 64;
+    for (int w = 0; w <= last; ++w) {
+      left[w] = (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+      right[w] = (row[w] >> 1) | (w < last ? row[w + 1] << 63 : 0);
+    }
+    left[0] |= (row[last] >> top) & 1;
+    left[last] &= tail_mask_;
+    right[last] |= (row[0] & 1) << top;
+  }
+
+  static inline void FullAdd(uint64_t a, uint64_t b, uint64_t c,
+                             uint64_t* sum, uint64_t* carry) {
+    const uint64_t t = a ^ b;
+    *sum = t ^ c;
+    *carry = (a & b) | (t & c);
+  }
+
+  GTORUS_KERNEL_CLONES
+  static void StepRow(const uint64_t* up, const uint64_t* up_l,
+                      const uint64_t* up_r, const uint64_t* mid,
+                      const uint64_t* mid_l, const uint64_t* mid_r,
+                      const uint64_t* down, const uint64_t* down_l,
+                      const uint64_t* down_r, uint64_t* out, int words,
+                      uint16_t birth, uint16_t survive) {
+    for (int w = 0; w < words; ++w) {
+      // Sum the 8 neighbor bits into bit planes s0 (ones) to s3 (eights).
+      uint64_t sa, ca, sb, cb, s0, d, t, e;
+      FullAdd(up_l[w], up[w], up_r[w], &sa, &ca);
+      FullAdd(mid_l[w], mid_r[w], down_l[w], &sb, &cb);
+      const uint64_t sc = down[w] ^ down_r[w];
+      const uint64_t cc = down[w] & down_r[w];
+      FullAdd(sa, sb, sc, &s0, &d);
+      FullAdd(ca, cb, cc, &t, &e);
+      const uint64_t s1 = t ^ d;
+      const uint64_t f = t & d;
+      const uint64_t s2 = e ^ f;
+      const uint64_t s3 = e & f;
+
+      // Apply the rule: OR together the cells whose count matches.
+      uint64_t born = 0;
+      uint64_t stay = 0;
+      for (int k = 0; k <= 8; ++k) {
+        const uint64_t match = ((k & 1) ? s0 : ~s0) & ((k & 2) ? s1 : ~s1) &
+                               ((k & 4) ? s2 : ~s2) & ((k & 8) ? s3 : ~s3);
+        born |= ((birth >> k) & 1) ? match : 0;
+        stay |= ((survive >> k) & 1) ? match : 0;
+      }
+      out[w] = (mid[w] & stay) | (~mid[w] & born);
+    }
+  }
+};
+
+#endif  // GTORUS_KERNEL_H_
@@ -0,0 +1,238 @@
+#ifndef HASHLIFE_H_
+#define HASHLIFE_H_
+
+// Hashlife on an n x n torus, n a power of two, for any outer-totalistic
+// rule given as birth/survive masks (see GTorusKernel::SetRule()).
+//
+// A state is a quadtree whose nodes are hash-consed: equal squares are
+// the same node, so two states are equal exactly when their root nodes
+// are, and the result of advancing a square is memoized per node. A
+// level k node is a 2^k x 2^k square; its result for 2^j generations
+// (j <= k - 2) is its centre square, of level k - 1, that many
+// generations later.
+//
+// The torus wraps around: it is advanced as the centre of the level
+// L + 1 square tiled with four copies of itself, each shifted by n / 2
+// so that the centre lines up with the original torus.
+//
+// Cell (x, y) is vertex x + n * y, as in GTorus.
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <array>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+class Hashlife {
+ public:
+  // A canonical node.
+  using Node = int32_t;
+
+  Hashlife(int n, uint16_t birth, uint16_t survive)
+      : n_(n), birth_(birth), survive_(survive) {
+    assert(n >= 4 && (n & (n - 1)) == 0);
+    levels_ = __builtin_ctz(n);
+    // Leaves: dead and live cells.
+    nodes_.push_back({{0, 0, 0, 0}, 0});
+    nodes_.push_back({{0, 0, 0, 0}, 1});
+    // Level 1 nodes, so that node kLevel1 + m has cells m (bit 0 nw,
+    // 1 ne, 2 sw, 3 se).
+    for (int m = 0; m < 16; ++m) {
+      Make(m & 1, (m >> 1) & 1, (m >> 2) & 1, (m >> 3) & 1);
+    }
+    // The level 1 result of every 4 x 4 square, by its cells (bit
+    // x + 4 * y).
+    for (int m = 0; m < (1 << 16); ++m) {
+      int centre = 0;
+      for (int k = 0; k < 4; ++k) {
+        const int x = 1 + (k & 1);
+        const int y = 1 + (k >> 1);
+        int live = 0;
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            if (dx != 0 || dy != 0) live += (m >> (x + dx + 4 * (y + dy))) & 1;
+          }
+        }
+        const bool alive = (m >> (x + 4 * y)) & 1;
+        centre |= (((alive ? survive_ : birth_) >> live) & 1) << k;
+      }
+      base_[m] = centre;
+    }
+    empty_.push_back(0);
+    for (int k = 1; k <= levels_ + 1; ++k) {
+      const Node e = empty_.back();
+      empty_.push_back(Make(e, e, e, e));
+    }
+  }
+
+  int size() const { return n_; }
+  uint16_t birth() const { return birth_; }
+  uint16_t survive() const { return survive_; }
+
+  // Nodes created so far; memory grows with it.
+  size_t NumNodes() const { return nodes_.size(); }
+
+  // The torus holding the packed state 'bits' (n * n bits).
+  Node FromState(const uint64_t* bits) { return Build(levels_, 0, 0, bits); }
+
+  // Write the state of 'torus' into 'bits', n * n bits.
+  void ToState(Node torus, std::vector<uint64_t>* bits) const {
+    bits->assign((size_t(n_) * n_ + 63) / 64, 0);
+    std::vector<int> live;
+    LiveCells(torus, &live);
+    for (int v : live) (*bits)[v >> 6] |= uint64_t{1} << (v & 63);
+  }
+
+  int64_t NumLive(Node node) const { return nodes_[node].population; }
+
+  // Append the live vertices of 'torus' to 'live'.
+  void LiveCells(Node torus, std::vector<int>* live) const {
+    Collect(torus, levels_, 0, 0, live);
+  }
+
+  // 'torus' advanced by 2^j generations, j < log2(n).
+  Node Step(Node torus, int j) {
+    assert(j < levels_);
+    const Node shifted = Make(Q(torus, 3), Q(torus, 2), Q(torus, 1),
+                              Q(torus, 0));
+    return Result(Make(shifted, shifted, shifted, shifted), levels_ + 1, j);
+  }
+
+  // 'torus' advanced by 'steps' generations, in O(log(steps)) calls of
+  // Step().
+  Node Advance(Node torus, uint64_t steps) {
+    while (steps > 0) {
+      int j = 63 - __builtin_clzll(steps);
+      if (j >= levels_) j = levels_ - 1;
+      torus = Step(torus, j);
+      steps -= uint64_t{1} << j;
+    }
+    return torus;
+  }
+
+ private:
+  static constexpr Node kLevel1 = 2;
+
+  struct NodeData {
+    // Quadrants nw, ne, sw, se.
+    std::array<Node, 4> child;
+    int64_t population;
+  };
+
+  const int n_;
+  const uint16_t birth_;
+  const uint16_t survive_;
+  // log2(n).
+  int levels_;
+  std::vector<NodeData> nodes_;
+  absl::flat_hash_map<std::array<Node, 4>, Node> canonical_;
+  // Memoized Result(), by node and j.
+  absl::flat_hash_map<uint64_t, Node> results_;
+  // The dead square of each level.
+  std::vector<Node> empty_;
+  // See the constructor.
+  std::array<uint8_t, 1 << 16> base_;
+
+  Node Q(Node node, int quadrant) const { return nodes_[node].child[quadrant]; }
+
+  Node Make(Node nw, Node ne, Node sw, Node se) {
+    const std::array<Node, 4> key = {nw, ne, sw, se};
+    const auto [it, inserted] = canonical_.try_emplace(key, nodes_.size());
+    if (inserted) {
+      nodes_.push_back({key, nodes_[nw].population + nodes_[ne].population +
+                                 nodes_[sw].population + nodes_[se].population});
+    }
+    return it->second;
+  }
+
+  // The centre of a node of level >= 2.
+  Node Centre(Node node) {
+    return Make(Q(Q(node, 0), 3), Q(Q(node, 1), 2), Q(Q(node, 2), 1),
+                Q(Q(node, 3), 0));
+  }
+
+  // The centre of 'node', of level 'level', 2^j generations on.
+  Node Result(Node node, int level, int j) {
+    // Dead squares stay dead, unless cells are born with no live
+    // neighbors.
+    if (nodes_[node].population == 0 && (birth_ & 1) == 0) {
+      return empty_[level - 1];
+    }
+    if (level == 2) {
+      int m = 0;
+      for (int q = 0; q < 4; ++q) {
+        const int cells = Q(node, q) - kLevel1;
+        for (int k = 0; k < 4; ++k) {
+          const int x = 2 * (q & 1) + (k & 1);
+          const int y = 2 * (q >> 1) + (k >> 1);
+          m |= ((cells >> k) & 1) << (x + 4 * y);
+        }
+      }
+      return kLevel1 + base_[m];
+    }
+    const uint64_t key = uint64_t(node) << 8 | j;
+    if (const auto it = results_.find(key); it != results_.end()) {
+      return it->second;
+    }
+    const Node a = Q(node, 0), b = Q(node, 1), c = Q(node, 2), d = Q(node, 3);
+    // The 3 x 3 overlapping squares of level - 1.
+    const Node sub[9] = {
+        a,
+        Make(Q(a, 1), Q(b, 0), Q(a, 3), Q(b, 2)),
+        b,
+        Make(Q(a, 2), Q(a, 3), Q(c, 0), Q(c, 1)),
+        Make(Q(a, 3), Q(b, 2), Q(c, 1), Q(d, 0)),
+        Make(Q(b, 2), Q(b, 3), Q(d, 0), Q(d, 1)),
+        c,
+        Make(Q(c, 1), Q(d, 0), Q(c, 3), Q(d, 2)),
+        d};
+    // At full speed both halves advance 2^(level - 3) generations;
+    // otherwise the first half advances 2^j and the second only
+    // recentres.
+    const bool full = j == level - 2;
+    Node r[9];
+    for (int k = 0; k < 9; ++k) {
+      r[k] = full ? Result(sub[k], level - 1, j - 1)
+                  : Result(sub[k], level - 1, j);
+    }
+    Node quad[4];
+    for (int q = 0; q < 4; ++q) {
+      const int k = 3 * (q >> 1) + (q & 1);
+      const Node square = Make(r[k], r[k + 1], r[k + 3], r[k + 4]);
+      quad[q] = full ? Result(square, level - 1, j - 1) : Centre(square);
+    }
+    const Node result = Make(quad[0], quad[1], quad[2], quad[3]);
+    results_.emplace(key, result);
+    return result;
+  }
+
+  Node Build(int level, int x0, int y0, const uint64_t* bits) {
+    if (level == 0) {
+      const size_t v = x0 + size_t(n_) * y0;
+      return (bits[v >> 6] >> (v & 63)) & 1;
+    }
+    const int h = 1 << (level - 1);
+    return Make(Build(level - 1, x0, y0, bits),
+                Build(level - 1, x0 + h, y0, bits),
+                Build(level - 1, x0, y0 + h, bits),
+                Build(level - 1, x0 + h, y0 + h, bits));
+  }
+
+  void Collect(Node node, int level, int x0, int y0,
+               std::vector<int>* live) const {
+    if (nodes_[node].population == 0) return;
+    if (level == 0) {
+      live->push_back(x0 + n_ * y0);
+      return;
+    }
+    const int h = 1 << (level - 1);
+    for (int q = 0; q < 4; ++q) {
+      Collect(Q(node, q), level - 1, x0 + h * (q & 1), y0 + h * (q >> 1),
+              live);
+    }
+  }
+};
+
+#endif  // HASHLIFE_H_
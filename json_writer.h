@@ -0,0 +1,171 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+// Streaming writer for graphs in the JSON format GLife reads.
+//
+// Output goes through one large buffer and is written with fwrite() when
+// the buffer fills, and names and integers are formatted by hand, so
+// dumping a graph with millions of edges costs a few hundred syscalls
+// rather than one flush per record.
+//
+//   GraphJSONWriter w(filename);
+//   w.Field("size", n);            // optional header fields
+//   w.BeginVertices();
+//   w.Vertex(name, live);          // for each vertex
+//   w.BeginEdges();
+//   w.Edge(s, t);                  // for each arc
+//   w.EndEdges();
+//   w.Close();                     // false on I/O errors
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+class GraphJSONWriter {
+ public:
+  explicit GraphJSONWriter(const std::string& filename)
+      : file_(fopen(filename.c_str(), "w")) {
+    buffer_.reserve(kBufferSize);
+    Append("{\n");
+  }
+
+  ~GraphJSONWriter() { Close(); }
+
+  GraphJSONWriter(const GraphJSONWriter&) = delete;
+  GraphJSONWriter& operator=(const GraphJSONWriter&) = delete;
+
+  // A top-level field, written before the vertices.
+  void Field(const char* key, const std::string& value) {
+    Key(key);
+    Name(value);
+    Append(",\n");
+  }
+  void Field(const char* key, int64_t value) {
+    Key(key);
+    Int(value);
+    Append(",\n");
+  }
+
+  void BeginVertices() {
+    Append("\"vertices\" : [\n");
+    first_ = true;
+  }
+
+  void Vertex(const std::string& name, bool live) {
+    Separator();
+    Append("{ \"name\" : ");
+    Name(name);
+    if (live) Append(", \"state\" : true ");
+    Append("}");
+  }
+
+  void BeginEdges() {
+    EndList();
+    Append(",\n\"edges\" : [\n");
+    first_ = true;
+  }
+
+  // The loader treats every arc as undirected, so writing each edge in
+  // one direction only is enough to reproduce the graph.
+  void Edge(const std::string& s, const std::string& t) {
+    Separator();
+    Append("{ \"s\" : ");
+    Name(s);
+    Append(", \"t\" : ");
+    Name(t);
+    Append(" }");
+  }
+
+  // Ends the edges and, unless 'more' is set, the document. With 'more'
+  // the caller appends further fields with Raw().
+  void EndEdges(bool more = false) {
+    EndList();
+    Append(more ? ",\n" : "}\n");
+  }
+
+  // Verbatim JSON text.
+  void Raw(const char* text) { Append(text); }
+
+  // Flush and close the file. Returns false if anything failed.
+  bool Close() {
+    if (file_ == nullptr) return ok_;
+    Flush();
+    ok_ = fclose(file_) == 0 && ok_;
+    file_ = nullptr;
+    return ok_;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = size_t{1} << 20;
+
+  FILE* file_;
+  bool ok_ = file_ != nullptr;
+  std::vector<char> buffer_;
+  // No element has been written since the last Begin*().
+  bool first_ = true;
+
+  void Flush() {
+    if (ok_ && !buffer_.empty()) {
+      ok_ = fwrite(buffer_.data(), 1, buffer_.size(), file_) == buffer_.size();
+    }
+    buffer_.clear();
+  }
+
+  void Append(const char* data, size_t n) {
+    if (buffer_.size() + n > kBufferSize) Flush();
+    if (n > kBufferSize) {
+      // Too large to buffer; write it through.
+      ok_ = ok_ && fwrite(data, 1, n, file_) == n;
+      return;
+    }
+    buffer_.insert(buffer_.end(), data, data + n);
+  }
+  void Append(const char* text) { Append(text, strlen(text)); }
+
+  void EndList() { Append(first_ ? "]" : "\n]"); }
+
+  void Separator() {
+    if (!first_) Append(",\n");
+    first_ = false;
+  }
+
+  void Key(const char* key) {
+    Name(key);
+    Append(" : ");
+  }
+
+  // A JSON string. Vertex names rarely need escaping, so the common
+  // case is one copy.
+  void Name(const std::string& name) {
+    if (name.find_first_of("\"\\") == std::string::npos) {
+      Append("\"", 1);
+      Append(name.data(), name.size());
+      Append("\"", 1);
+      return;
+    }
+    std::string escaped = "\"";
+    for (const char c : name) {
+      if (c == '"' || c == '\\') escaped += '\\';
+      escaped += c;
+    }
+    escaped += '"';
+    Append(escaped.data(), escaped.size());
+  }
+
+  void Int(int64_t value) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    uint64_t v = value < 0 ? -uint64_t(value) : uint64_t(value);
+    do {
+      *--p = '0' + v % 10;
+      v /= 10;
+    } while (v != 0);
+    if (value < 0) *--p = '-';
+    Append(p, digits + sizeof(digits) - p);
+  }
+};
+
+#endif  // JSON_WRITER_H_
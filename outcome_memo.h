@@ -0,0 +1,137 @@
+#ifndef OUTCOME_MEMO_H_
+#define OUTCOME_MEMO_H_
+
+// Outcomes of states seen by earlier simulations of the same graph and
+// rule, shared by all threads: how many steps the state is from its
+// cycle, the cycle length and the entropy over the cycle. Random states
+// tend to run into a few attractors, so a new trajectory can often stop
+// at the first recorded state it reaches.
+//
+// States are keyed by a 128-bit fingerprint, so results are exact up to
+// fingerprint collisions. The table has a fixed size: it is split into
+// shards, each behind its own lock, of 4-way sets; a full set replaces
+// its oldest entry.
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "glife.h"
+#include "profile.h"
+
+struct StateKey {
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+
+  bool operator==(const StateKey& other) const {
+    return lo == other.lo && hi == other.hi;
+  }
+};
+
+// Two independent sums of mixed words, as in GLife::Fingerprint().
+inline StateKey KeyOf(const GLife::State& state) {
+  StateKey key;
+  for (size_t w = 0; w < state.size(); ++w) {
+    key.lo += GLife::MixWord(state[w], w);
+    key.hi += GLife::MixWord(state[w], w + (uint64_t{1} << 40));
+  }
+  return key;
+}
+
+class OutcomeMemo {
+ public:
+  struct Outcome {
+    // Steps to the first state of the cycle; 0 on the cycle.
+    int remaining = 0;
+    int cycle_len = 0;
+    // Entropy over the cycle states.
+    double entropy = 0;
+    // For a state on the cycle, the key of the one before it there.
+    StateKey cycle_pred;
+  };
+
+  // A table of about 'bytes' bytes.
+  explicit OutcomeMemo(size_t bytes)
+      : num_sets_(std::max<size_t>(
+            1, bytes / (kShards * kWays * sizeof(Entry) + kShards))),
+        shards_(new Shard[kShards]) {
+    for (int s = 0; s < kShards; ++s) {
+      shards_[s].entries.resize(num_sets_ * kWays);
+      shards_[s].next_victim.resize(num_sets_);
+    }
+  }
+
+  bool Find(const StateKey& key, Outcome* outcome) const {
+    GLIFE_PROFILE_COUNT(kMemoLookups, 1);
+    Shard& shard = shards_[key.hi % kShards];
+    const Entry* set = &shard.entries[key.lo % num_sets_ * kWays];
+    std::lock_guard<std::mutex> lock(shard.mu);
+    for (int w = 0; w < kWays; ++w) {
+      if (set[w].outcome.cycle_len > 0 && set[w].key == key) {
+        GLIFE_PROFILE_COUNT(kMemoHits, 1);
+        *outcome = set[w].outcome;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Insert(const StateKey& key, const Outcome& outcome) {
+    Shard& shard = shards_[key.hi % kShards];
+    const size_t s = key.lo % num_sets_;
+    Entry* set = &shard.entries[s * kWays];
+    std::lock_guard<std::mutex> lock(shard.mu);
+    for (int w = 0; w < kWays; ++w) {
+      if (set[w].outcome.cycle_len == 0 || set[w].key == key) {
+        set[w] = {key, outcome};
+        return;
+      }
+    }
+    uint8_t& victim = shard.next_victim[s];
+    set[victim] = {key, outcome};
+    victim = (victim + 1) % kWays;
+  }
+
+  // Record a trajectory, by the keys of its states in order, whose cycle
+  // starts at index 'cycle_begin'. 'keys' holds either the states before
+  // the cycle only, or those and the whole cycle.
+  void Record(const std::vector<StateKey>& keys, int cycle_begin,
+              int cycle_len, double entropy) {
+    assert(keys.size() <= cycle_begin ||
+           keys.size() == cycle_begin + cycle_len);
+    for (int j = 0; j < keys.size(); ++j) {
+      Outcome outcome = {std::max(0, cycle_begin - j), cycle_len, entropy};
+      if (j >= cycle_begin) {
+        outcome.cycle_pred =
+            keys[j > cycle_begin ? j - 1 : cycle_begin + cycle_len - 1];
+      }
+      Insert(keys[j], outcome);
+    }
+  }
+
+ private:
+  static constexpr int kShards = 64;
+  static constexpr int kWays = 4;
+
+  struct Entry {
+    StateKey key;
+    // Empty while cycle_len is 0.
+    Outcome outcome;
+  };
+
+  struct alignas(64) Shard {
+    std::mutex mu;
+    std::vector<Entry> entries;
+    // The way each full set replaces next.
+    std::vector<uint8_t> next_victim;
+  };
+
+  const size_t num_sets_;
+  const std::unique_ptr<Shard[]> shards_;
+};
+
+#endif  // OUTCOME_MEMO_H_
@@ -0,0 +1,210 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+// Phase timers and event counters for the simulation hot paths, built
+// only when GLIFE_PROFILE is defined ("make PROFILE=1"). Otherwise the
+// macros expand to nothing and WriteProfile() writes nothing.
+//
+//   GLIFE_PROFILE_SCOPE(kUpdate);        time the rest of the scope
+//   GLIFE_PROFILE_COUNT(kSteps, 1);      add to a counter
+//
+// Each thread adds to its own counters, which are registered once, on
+// the thread's first event, and never freed; WriteProfile() sums them
+// over threads. Phase times are inclusive, so e.g. "simulate" contains
+// the "update", "state_hash" and "entropy" time of its runs. Profiling
+// builds also count the bytes and blocks each thread allocates, from
+// its first event on.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace profile {
+
+enum Phase {
+  kLoadGraph,
+  kUpdate,
+  kGetStateStr,
+  kStateHash,
+  kEntropy,
+  kSimulate,
+  kMultiTrialStep,
+  kSaveResults,
+  kDumpJSON,
+  kCheckpoint,
+  kNumPhases
+};
+
+enum Counter {
+  kSteps,
+  kCellsEvaluated,
+  kStateHashProbes,
+  kSimulations,
+  kMemoLookups,
+  kMemoHits,
+  kBytesAllocated,
+  kAllocations,
+  kNumCounters
+};
+
+inline const char* const kPhaseNames[kNumPhases] = {
+    "load_graph", "update",           "get_state_str",
+    "state_hash", "entropy",          "simulate",
+    "multi_trial_step", "save_results", "dump_json",
+    "checkpoint"};
+inline const char* const kCounterNames[kNumCounters] = {
+    "steps",       "cells_evaluated", "state_hash_probes",
+    "simulations", "memo_lookups",    "memo_hits",
+    "bytes_allocated", "allocations"};
+
+#ifdef GLIFE_PROFILE
+
+struct ThreadProfile {
+  // Written by the owning thread only, read by WriteProfile().
+  std::atomic<uint64_t> phase_ns[kNumPhases] = {};
+  std::atomic<uint64_t> phase_calls[kNumPhases] = {};
+  std::atomic<uint64_t> counters[kNumCounters] = {};
+};
+
+// A plain add: each counter has a single writer.
+inline void Add(std::atomic<uint64_t>& c, uint64_t n) {
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct Registry {
+  std::mutex mu;
+  std::vector<std::unique_ptr<ThreadProfile>> threads;
+};
+
+// Never destroyed, so threads can still report while the program exits.
+inline Registry& GetRegistry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+// The calling thread's profile, if it has had an event yet. Allocations
+// made while registering see null here and are not counted.
+inline thread_local ThreadProfile* current = nullptr;
+
+inline ThreadProfile& ThisThread() {
+  if (current == nullptr) {
+    auto profile = std::make_unique<ThreadProfile>();
+    ThreadProfile* p = profile.get();
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mu);
+    registry.threads.push_back(std::move(profile));
+    current = p;
+  }
+  return *current;
+}
+
+inline void Count(Counter counter, uint64_t n) {
+  Add(ThisThread().counters[counter], n);
+}
+
+inline uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Phase phase) : phase_(phase), start_(NowNs()) {}
+  ~ScopedTimer() {
+    ThreadProfile& t = ThisThread();
+    Add(t.phase_ns[phase_], NowNs() - start_);
+    Add(t.phase_calls[phase_], 1);
+  }
+
+ private:
+  const Phase phase_;
+  const uint64_t start_;
+};
+
+// Totals over all threads so far.
+inline uint64_t Total(Counter counter) {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mu);
+  uint64_t total = 0;
+  for (const auto& t : registry.threads) total += t->counters[counter];
+  return total;
+}
+
+// Write the totals over all threads as JSON. Returns false on I/O
+// errors.
+inline bool WriteProfile(const std::string& filename) {
+  uint64_t ns[kNumPhases] = {};
+  uint64_t calls[kNumPhases] = {};
+  uint64_t counters[kNumCounters] = {};
+  Registry& registry = GetRegistry();
+  int num_threads;
+  {
+    std::lock_guard<std::mutex> lock(registry.mu);
+    num_threads = registry.threads.size();
+    for (const auto& t : registry.threads) {
+      for (int p = 0; p < kNumPhases; ++p) {
+        ns[p] += t->phase_ns[p];
+        calls[p] += t->phase_calls[p];
+      }
+      for (int c = 0; c < kNumCounters; ++c) counters[c] += t->counters[c];
+    }
+  }
+  FILE* f = fopen(filename.c_str(), "w");
+  if (f == nullptr) return false;
+  fprintf(f, "{\n  \"threads\": %d,\n  \"phases\": {\n", num_threads);
+  for (int p = 0; p < kNumPhases; ++p) {
+    fprintf(f, "    \"%s\": {\"calls\": %llu, \"seconds\": %.6f}%s\n",
+            kPhaseNames[p], (unsigned long long)calls[p], ns[p] * 1e-9,
+            p + 1 < kNumPhases ? "," : "");
+  }
+  fprintf(f, "  },\n  \"counters\": {\n");
+  for (int c = 0; c < kNumCounters; ++c) {
+    fprintf(f, "    \"%s\": %llu%s\n", kCounterNames[c],
+            (unsigned long long)counters[c], c + 1 < kNumCounters ? "," : "");
+  }
+  fprintf(f, "  }\n}\n");
+  return fclose(f) == 0;
+}
+
+#define GLIFE_PROFILE_CONCAT_(a, b) a##b
+#define GLIFE_PROFILE_CONCAT(a, b) GLIFE_PROFILE_CONCAT_(a, b)
+#define GLIFE_PROFILE_SCOPE(phase)                               \
+  ::profile::ScopedTimer GLIFE_PROFILE_CONCAT(profile_timer_, \
+                                              __LINE__)(::profile::phase)
+#define GLIFE_PROFILE_COUNT(counter, n) ::profile::Count(::profile::counter, n)
+
+#else  // !GLIFE_PROFILE
+
+inline bool WriteProfile(const std::string& filename) { return true; }
+
+#define GLIFE_PROFILE_SCOPE(phase)
+#define GLIFE_PROFILE_COUNT(counter, n)
+
+#endif  // GLIFE_PROFILE
+
+}  // namespace profile
+
+#ifdef GLIFE_PROFILE
+// Every program is a single translation unit, so these are defined once.
+void* operator new(size_t size) {
+  if (profile::ThreadProfile* t = profile::current) {
+    profile::Add(t->counters[profile::kBytesAllocated], size);
+    profile::Add(t->counters[profile::kAllocations], 1);
+  }
+  if (void* p = malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#endif  // GLIFE_PROFILE
+
+#endif  // PROFILE_H_
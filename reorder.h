@@ -0,0 +1,169 @@
+#ifndef REORDER_H_
+#define REORDER_H_
+
+// Vertex numberings that keep neighbors close in memory, for
+// GLife::Reorder(). Each returns 'order', where order[k] is the vertex
+// to be numbered k.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "gtopology.h"
+
+enum class VertexOrder {
+  // Breadth-first from the lowest numbered vertex of each component.
+  kBFS,
+  // Reverse Cuthill-McKee.
+  kRCM,
+  // Along a Hilbert curve over the (i, j) of vertices named "i_j".
+  kHilbert,
+};
+
+// "bfs", "rcm" or "hilbert".
+inline bool ParseVertexOrder(const std::string& spec, VertexOrder* order) {
+  if (spec == "bfs") {
+    *order = VertexOrder::kBFS;
+  } else if (spec == "rcm") {
+    *order = VertexOrder::kRCM;
+  } else if (spec == "hilbert") {
+    *order = VertexOrder::kHilbert;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Append the vertices reachable from 'root' in breadth-first order,
+// taking the neighbors of each vertex by increasing degree if
+// 'by_degree', else in numbering order.
+inline void AppendBFS(const GTopology& topology, int root, bool by_degree,
+                      std::vector<char>* visited, std::vector<int>* order) {
+  const std::vector<int>& offsets = topology.Offsets();
+  const std::vector<int>& neighbors = topology.Neighbors();
+  size_t head = order->size();
+  order->push_back(root);
+  (*visited)[root] = 1;
+  while (head < order->size()) {
+    const int v = (*order)[head++];
+    const size_t first = order->size();
+    for (int k = offsets[v]; k < offsets[v + 1]; ++k) {
+      const int u = neighbors[k];
+      if ((*visited)[u]) continue;
+      (*visited)[u] = 1;
+      order->push_back(u);
+    }
+    if (by_degree) {
+      std::stable_sort(order->begin() + first, order->end(),
+                       [&topology](int a, int b) {
+                         return topology.Degree(a) < topology.Degree(b);
+                       });
+    }
+  }
+}
+
+inline std::vector<int> BFSOrder(const GTopology& topology) {
+  const int n = topology.NumVertices();
+  std::vector<char> visited(n);
+  std::vector<int> order;
+  order.reserve(n);
+  for (int v = 0; v < n; ++v) {
+    if (!visited[v]) AppendBFS(topology, v, false, &visited, &order);
+  }
+  return order;
+}
+
+// Each component starts from a vertex of least degree in the last level
+// of a breadth-first search from its vertex of least degree, which is
+// far from the middle of the component and so gives a narrow band.
+inline std::vector<int> RCMOrder(const GTopology& topology) {
+  const int n = topology.NumVertices();
+  std::vector<int> by_degree(n);
+  std::iota(by_degree.begin(), by_degree.end(), 0);
+  std::stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b) {
+    return topology.Degree(a) < topology.Degree(b);
+  });
+  const std::vector<int>& offsets = topology.Offsets();
+  const std::vector<int>& neighbors = topology.Neighbors();
+  std::vector<char> visited(n);
+  std::vector<int> order;
+  order.reserve(n);
+  // Breadth-first depth from the current 'start'; -1 if not reached.
+  std::vector<int> level(n, -1);
+  std::vector<int> probe;
+  for (int start : by_degree) {
+    if (visited[start]) continue;
+    probe.assign(1, start);
+    level[start] = 0;
+    for (size_t head = 0; head < probe.size(); ++head) {
+      const int v = probe[head];
+      for (int k = offsets[v]; k < offsets[v + 1]; ++k) {
+        const int u = neighbors[k];
+        if (level[u] >= 0) continue;
+        level[u] = level[v] + 1;
+        probe.push_back(u);
+      }
+    }
+    int root = probe.back();
+    for (int v : probe) {
+      if (level[v] == level[probe.back()] &&
+          topology.Degree(v) < topology.Degree(root)) {
+        root = v;
+      }
+    }
+    AppendBFS(topology, root, true, &visited, &order);
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+// Position of (x, y) along the Hilbert curve over a side x side grid,
+// side a power of two.
+inline uint64_t HilbertIndex(uint64_t side, uint64_t x, uint64_t y) {
+  uint64_t d = 0;
+  for (uint64_t s = side / 2; s > 0; s /= 2) {
+    const uint64_t rx = (x & s) > 0;
+    const uint64_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant.
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+// False unless every vertex is named "i_j".
+inline bool HilbertOrder(const GTopology& topology, std::vector<int>* order) {
+  const int n = topology.NumVertices();
+  std::vector<uint64_t> x(n), y(n);
+  uint64_t side = 1;
+  for (int v = 0; v < n; ++v) {
+    unsigned i, j;
+    char end;
+    if (sscanf(topology.VertexNames()[v].c_str(), "%u_%u%c", &i, &j, &end) !=
+        2) {
+      return false;
+    }
+    x[v] = i;
+    y[v] = j;
+    while (side <= std::max(x[v], y[v])) side *= 2;
+  }
+  std::vector<uint64_t> index(n);
+  for (int v = 0; v < n; ++v) index[v] = HilbertIndex(side, x[v], y[v]);
+  order->resize(n);
+  std::iota(order->begin(), order->end(), 0);
+  std::stable_sort(order->begin(), order->end(),
+                   [&index](int a, int b) { return index[a] < index[b]; });
+  return true;
+}
+
+#endif  // REORDER_H_
@@ -0,0 +1,77 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+// Counter-based random numbers. Rng(seed, stream) is a pure function of
+// its arguments, so work split across threads by stream (a vertex, a
+// chunk, a trial) draws the same numbers whatever the thread count.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <random>
+
+// The SplitMix64 output function: a bijective mix of all 64 bits.
+inline uint64_t SplitMix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+class Rng {
+ public:
+  Rng(uint64_t seed, uint64_t stream)
+      : state_(SplitMix64(seed + SplitMix64(stream + kGamma))) {}
+
+  uint64_t Next() {
+    state_ += kGamma;
+    return SplitMix64(state_);
+  }
+
+  // Uniform in [0, n), by multiply-shift; the bias is below n / 2^64.
+  uint64_t Below(uint64_t n) {
+    return uint64_t((unsigned __int128)Next() * n >> 64);
+  }
+
+  // Uniform in [0, 1).
+  double Unit() { return (Next() >> 11) * 0x1.0p-53; }
+
+ private:
+  static constexpr uint64_t kGamma = 0x9e3779b97f4a7c15ULL;
+  uint64_t state_;
+};
+
+namespace rng_internal {
+inline std::atomic<uint64_t> thread_seed{
+    uint64_t{std::random_device{}()} << 32 | std::random_device{}()};
+inline std::atomic<uint64_t> next_stream{0};
+// Bumped by SeedThreadRng() so that each thread reseeds on its next draw.
+inline std::atomic<uint64_t> epoch{1};
+}  // namespace rng_internal
+
+// Seed the generators of ThreadRng(). Threads draw from consecutive
+// streams of 'seed' in the order they first draw after this call, so a
+// single thread gets the same numbers for the same seed. Without a call,
+// the seed comes from std::random_device.
+inline void SeedThreadRng(uint64_t seed) {
+  rng_internal::thread_seed = seed;
+  rng_internal::next_stream = 0;
+  rng_internal::epoch += 1;
+}
+
+// A generator owned by the calling thread, for draws that need not be
+// the same whatever the thread count, e.g. random edits of a graph.
+inline Rng& ThreadRng() {
+  thread_local uint64_t epoch = 0;
+  thread_local Rng rng(0, 0);
+  const uint64_t current = rng_internal::epoch.load();
+  if (epoch != current) {
+    epoch = current;
+    rng = Rng(rng_internal::thread_seed, rng_internal::next_stream++);
+  }
+  return rng;
+}
+
+#endif  // RNG_H_
@@ -0,0 +1,122 @@
+#ifndef RULES_H_
+#define RULES_H_
+
+// The transition rules the drivers offer, as GLife new state functions,
+// and a parser for their one-line spellings.
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glife.h"
+
+using RuleFn = std::function<bool(bool, int, int)>;
+
+// Flip a vertex when the fraction of live neighbors exceeds 'threshold'.
+inline RuleFn DensityRule(double threshold) {
+  return [threshold](bool live, int num_neighbors, int num_live_neighbors) {
+    const double density = (double) num_live_neighbors / num_neighbors;
+    if (density > threshold) {
+      return !live;
+    }
+    return live;
+  };
+}
+
+inline RuleFn UnderpopulationRule(int i0, int i1) {
+  return [i0, i1](bool live, int num_neighbors, int num_live_neighbors) {
+    // Dead vertex becomes alive if it has at least i0 live neighbors.
+    // Live vertex remains alive if it has at least i1 live neighbors.
+    if (!live && num_live_neighbors >= i0) return true;
+    if (live && num_live_neighbors >= i1) return true;
+    return false;
+  };
+}
+
+inline RuleFn OverpopulationRule(int i0, int i1) {
+  return [i0, i1](bool live, int num_neighbors, int num_live_neighbors) {
+    // Dead vertex becomes alive if it has at least i0 live neighbors.
+    // Live vertex remains alive if it has at most i1 live neighbors.
+    if (!live && num_live_neighbors >= i0) return true;
+    if (live && num_live_neighbors <= i1) return true;
+    return false;
+  };
+}
+
+// Modified Conway rule.
+inline RuleFn ConwayRule(int i0, int i1, int i2) {
+  return [i0, i1, i2](bool live, int num_neighbors, int num_live_neighbors) {
+    // Dead vertex becomes alive if it has exactly i1 live neighbors.
+    if (num_live_neighbors == i1) return true;
+
+    // Dead if i0 or fewer or more than i2 neighbors.
+    if (num_live_neighbors <= i0 || num_live_neighbors > i2) return false;
+
+    // Otherwise remain in current state.
+    return live;
+  };
+}
+
+// A dead vertex is born with a live neighbor count in 'b', a live one
+// survives with a count in 's'.
+inline RuleFn BirthSurviveRule(std::vector<int> b, std::vector<int> s) {
+  return [b = std::move(b), s = std::move(s)](bool live, int num_neighbors,
+                                              int num_live_neighbors) {
+    if (!live &&
+        std::find(b.begin(), b.end(), num_live_neighbors) != b.end()) {
+      return true;
+    }
+    if (live &&
+        std::find(s.begin(), s.end(), num_live_neighbors) != s.end()) {
+      return true;
+    }
+    return false;
+  };
+}
+
+// Parse a rule spelled as one of
+//   life                      GLife::NewStateConway
+//   B3/S23                    BirthSurviveRule, one digit per count
+//   density 0.4               DensityRule
+//   underpopulation 2 3       UnderpopulationRule
+//   overpopulation 3 4        OverpopulationRule
+//   conway 1 3 4              ConwayRule
+// Returns false if 'spec' is none of these.
+inline bool ParseRule(const std::string& spec, RuleFn* fn) {
+  std::istringstream iss(spec);
+  std::string name;
+  iss >> name;
+  std::vector<double> args;
+  for (double x; iss >> x;) args.push_back(x);
+  if (!iss.eof()) return false;
+
+  if (name == "life" && args.empty()) {
+    *fn = GLife::NewStateConway;
+  } else if (name[0] == 'B' && args.empty()) {
+    const size_t slash = name.find("/S");
+    if (slash == std::string::npos) return false;
+    std::vector<int> b, s;
+    for (size_t k = 1; k < name.size(); ++k) {
+      if (k == slash || k == slash + 1) continue;
+      if (!isdigit(name[k])) return false;
+      (k < slash ? b : s).push_back(name[k] - '0');
+    }
+    *fn = BirthSurviveRule(std::move(b), std::move(s));
+  } else if (name == "density" && args.size() == 1) {
+    *fn = DensityRule(args[0]);
+  } else if (name == "underpopulation" && args.size() == 2) {
+    *fn = UnderpopulationRule(args[0], args[1]);
+  } else if (name == "overpopulation" && args.size() == 2) {
+    *fn = OverpopulationRule(args[0], args[1]);
+  } else if (name == "conway" && args.size() == 3) {
+    *fn = ConwayRule(args[0], args[1], args[2]);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#endif  // RULES_H_
@@ -9,40 +9,19 @@
 #include <unordered_map>
 #include <fstream>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "brent.h"
+#include "entropy.h"
 #include "glife.h"
+#include "rules.h"
 
 ABSL_FLAG(bool, verbose, false, "Be verbose");
-
-double ShannonEntropy(std::vector<std::string>::iterator begin,
-                      std::vector<std::string>::iterator end) {
-  assert(begin != end);
-
-  const size_t num_nodes = begin->size();
-  std::vector<int> v(num_nodes);
-  for (auto it = begin; it != end; ++it) {
-    assert(it->size() == num_nodes);
-    for (int j = 0; j < num_nodes; j++) {
-      v[j] += (*it)[j] == '1' ? 1 : 0;
-    }
-  }
-  double result = 0.0;
-  const int cycle_len = end - begin;
-  for (const auto count : v) {
-    assert(count <= cycle_len);
-    double p1 = (double)count / cycle_len;
-    assert(p1 <= 1.0);
-    assert(0.0 <= p1);
-    double p0 = 1.0 - p1;
-    assert(p0 <= 1.0);
-    assert(0.0 <= p0);
-
-    if (p0 != 0) { result -= p0 * std::log2(p0); }
-    if (p1 != 0) { result -= p1 * std::log2(p1); }
-  }
-  return result / num_nodes;
-}
+ABSL_FLAG(bool, brent, false,
+          "Detect cycles with Brent's algorithm in O(vertices) memory; "
+          "costs up to about twice the steps of the default, e.g. "
+          "2000 for a state that does not cycle in 1000");
 
 void usage(const char *argv0)
 {
@@ -57,45 +36,33 @@ double OneSimulation(GLife& glife)
   const bool verbose = absl::GetFlag(FLAGS_verbose);
 
   // Simulate GOL
-  // Save intermediate states 
-  // 1. to detect cycle
-  std::unordered_map<std::string, int> states;
-  // 2. to dump to file
-  std::vector<std::string> doc_states;
+  // Save intermediate states to detect cycle.
+  absl::flat_hash_map<GLife::State, int> states;
+  // Entropy is accumulated as states are produced.
+  EntropyAccumulator entropy(glife.NumVertices());
 
   int cycle_begin = -1;
-  int cycle_end = -1;
   int i;
   for (i = 0; i < max_steps; ++i) {
-    const std::string state = glife.GetStateStr();
-    // std::cout << i << ": " << state << std::endl;
+    const GLife::State& state = glife.GetState();
     const auto [it, inserted] = states.insert({state, i});
     if (inserted) {
       // A new state.
+      entropy.Add(state);
       glife.Update();
-      doc_states.push_back(std::move(state));
     } else { 
       cycle_begin = it->second;
       if (verbose) {
         std::cout << "Finite path: " << it->second;
         std::cout << ", Cycle length: " << i - cycle_begin << " ";
       }
-      cycle_end = i;
-
-      // Make cycle repeat N=10 times.
-      const int N = 10;
-      std::vector<std::string> cycle(
-          doc_states.begin() + it->second, doc_states.end());
-      for (int j = 0; j < N; j++) {
-        doc_states.insert(doc_states.end(), cycle.begin(), cycle.end());
-      }
       break;
     }
   }
   double shannon_entropy = 0.0;
   if (i == max_steps) {
     // No cycle found within max_steps
-    shannon_entropy = ShannonEntropy(doc_states.begin(), doc_states.end());
+    shannon_entropy = entropy.Entropy();
     if (verbose) {
       std::cout << "Finite path: unknown";
       std::cout << ", Cycle length: unknown" << std::endl;
@@ -103,8 +70,14 @@ double OneSimulation(GLife& glife)
     }
   } else {
     assert(cycle_begin != -1);
-    shannon_entropy = ShannonEntropy(doc_states.begin() + cycle_begin,
-                                     doc_states.begin() + cycle_end);
+    // 'glife' is back at the first state of the cycle: go around it once
+    // more to count just the cycle states.
+    entropy.Checkpoint();
+    for (int j = cycle_begin; j < i; ++j) {
+      entropy.Add(glife.GetState());
+      glife.Update();
+    }
+    shannon_entropy = entropy.EntropySinceCheckpoint();
     if (verbose) {
       printf("Shannon entropy: %6.2f\n", shannon_entropy);
     }
@@ -112,6 +85,42 @@ double OneSimulation(GLife& glife)
   return shannon_entropy;
 }
 
+// Same as OneSimulation(), but finds the cycle with Brent's algorithm
+// and replays it to compute the entropy, so memory does not grow with
+// the number of steps. Without a cycle, the search itself collects the
+// entropy.
+double OneSimulationBrent(GLife& glife)
+{
+  const int max_steps = 1000;
+
+  const bool verbose = absl::GetFlag(FLAGS_verbose);
+
+  EntropyAccumulator entropy(glife.NumVertices());
+  const auto cycle = FindCycleBrent(glife, max_steps, &entropy);
+  if (cycle) {
+    // 'glife' is at the first state of the cycle.
+    if (verbose) {
+      std::cout << "Finite path: " << cycle->transient;
+      std::cout << ", Cycle length: " << cycle->cycle_len << " ";
+    }
+    entropy.Checkpoint();
+    for (int i = 0; i < cycle->cycle_len; ++i) {
+      entropy.Add(glife.GetState());
+      glife.Update();
+    }
+  }
+  const double shannon_entropy =
+      cycle ? entropy.EntropySinceCheckpoint() : entropy.Entropy();
+  if (verbose) {
+    if (!cycle) {
+      std::cout << "Finite path: unknown";
+      std::cout << ", Cycle length: unknown" << std::endl;
+    }
+    printf("Shannon entropy: %6.2f\n", shannon_entropy);
+  }
+  return shannon_entropy;
+}
+
 int main(int argc, char *argv[]) 
 {
   const auto args = absl::ParseCommandLine(argc, argv);
@@ -127,31 +136,25 @@ int main(int argc, char *argv[])
   }
 
   const bool verbose = absl::GetFlag(FLAGS_verbose);
+  const bool brent = absl::GetFlag(FLAGS_brent);
 
   GLife zygote(graph_filename);
 
+  // Every mu runs the same states; read them once.
+  std::vector<std::string> states;
+  std::ifstream ifs(states_filename);
+  for (std::string state; ifs >> state;) states.push_back(std::move(state));
+
   auto start = std::chrono::steady_clock::now();
   for (double mu = 0.1; mu < 1.0; mu += 0.1) {
     int count_states = 0;
-    std::ifstream ifs(states_filename);
     double average_entropy = 0.0;
-    while (true) {
-      std::string state;
-      ifs >> state;
-      if (ifs.eof()) break;
-    
-      GLife glife(zygote);
+    GLife glife(zygote);
+    glife.SetNewStateFn(DensityRule(mu));
+    for (const auto& state : states) {
       glife.SetState(state);
-      glife.SetNewStateFn([mu](bool live, int num_neighbors, int num_live_neighbors) {
-        const double density = (double)num_live_neighbors / num_neighbors;
-        if (density > mu) {
-          // flip
-          return !live;
-        }
-        // stay the same
-        return live;
-      });
-      average_entropy += OneSimulation(glife);
+      average_entropy += brent ? OneSimulationBrent(glife)
+                               : OneSimulation(glife);
       count_states += 1;
       if (verbose && (count_states % 10) == 0) {
         auto end = std::chrono::steady_clock::now();
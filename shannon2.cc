@@ -7,28 +7,90 @@
 #include <errno.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iomanip>
-#include <future>
+#include <memory>
 
-#include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/strings/strip.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_replace.h"
+#include "checkpoint.h"
 #include "glife.h"
+#include "outcome_memo.h"
+#include "profile.h"
+#include "rules.h"
+#include "shard.h"
+#include "simulate.h"
+#include "state_gen.h"
+#include "states_file.h"
+#include "work_pool.h"
 
 ABSL_FLAG(bool, verbose, false, "Be verbose");
 ABSL_FLAG(bool, print_states, false, "Print each state in evolution");
 ABSL_FLAG(bool, count_live, false, "Count live cells in each generation");
 ABSL_FLAG(int, num_threads, 1, "Number of threads to use");
+ABSL_FLAG(int, update_threads, 1,
+          "Threads to use inside each simulation, for very large graphs");
 ABSL_FLAG(int, num_rewire, 0, "Number of rewirings to perform");
 ABSL_FLAG(int, num_remove, 0, "Number of edges to remove");
 ABSL_FLAG(int, num_add, 0, "Number of edges to add");
+ABSL_FLAG(uint64_t, edit_seed, 0,
+          "Seed for --num_rewire, --num_remove and --num_add; 0 for random");
+ABSL_FLAG(bool, log_edits, false, "Print each edit of the graph on stderr");
 ABSL_FLAG(int, max_steps, 4000, "Max number of simulations to run");
+ABSL_FLAG(bool, brent, false,
+          "Detect cycles with Brent's algorithm in O(vertices) memory; "
+          "costs up to about twice the steps of the default, e.g. "
+          "2 * --max_steps for a state that does not cycle in time");
+ABSL_FLAG(bool, hashlife, false,
+          "Simulate with memoized quadtrees (Hashlife), fastest on large, "
+          "sparse or periodic patterns; the graph must be a torus whose "
+          "size is a power of two");
+ABSL_FLAG(int, memo_mb, 0,
+          "Megabytes for outcomes shared between simulations, so that a "
+          "trajectory stops at the first state seen before; 0 for none. "
+          "Only with the default cycle detection, without --print_states "
+          "or --count_live");
+ABSL_FLAG(bool, multi_trial, false,
+          "Advance 64 states at a time per thread in bit-sliced lanes");
+ABSL_FLAG(bool, incremental, false,
+          "Only re-evaluate vertices next to those that changed last step");
+ABSL_FLAG(std::string, reorder, "",
+          "Renumber vertices for memory locality after loading and editing "
+          "the graph: bfs, rcm (reverse Cuthill-McKee) or hilbert (for "
+          "vertices named i_j); outputs are unaffected");
+ABSL_FLAG(bool, compact_json, false,
+          "Write each edge of a modified graph once rather than per direction");
+ABSL_FLAG(bool, graph_cache, true,
+          "Load JSON graphs through a binary cache file beside them, "
+          "creating it if needed");
+
+ABSL_FLAG(int, generate_states, 0,
+          "Simulate this many random states instead of reading a states file");
+ABSL_FLAG(double, live_fraction, 0.5,
+          "Fraction of live vertices in each generated state");
+ABSL_FLAG(uint64_t, seed, 1, "Seed for generated states");
+
+ABSL_FLAG(std::string, shard, "",
+          "i/N: simulate only states i, i + N, i + 2N, ... of the states "
+          "file; shardmerge combines the outputs of all N shards");
+
+ABSL_FLAG(double, checkpoint_secs, 0,
+          "Sync finished results to checkpoint.log in the output directory "
+          "at most this often, in seconds, so that the run can be resumed; "
+          "0 for no checkpoints");
+ABSL_FLAG(bool, resume, false,
+          "Continue an interrupted run in --output_dir, skipping the states "
+          "its checkpoint has results for. Needs --checkpoint_secs and the "
+          "same arguments and input files; a checkpoint of any other run "
+          "is refused");
 
 ABSL_FLAG(double, density_threshold, 0, "Use density rule with the given threshold");
 
@@ -48,117 +110,14 @@ ABSL_FLAG(std::vector<std::string>, S, {},
 ABSL_FLAG(std::vector<std::string>, conway, {},
           "Use modified Conway rule with 3 given thresholds");
 
-double ShannonEntropy(std::vector<std::string>::iterator begin,
-                      std::vector<std::string>::iterator end) {
-  assert(begin != end);
-
-  const size_t num_nodes = begin->size();
-  std::vector<int> v(num_nodes);
-  for (auto it = begin; it != end; ++it) {
-    assert(it->size() == num_nodes);
-    for (int j = 0; j < num_nodes; j++) {
-      v[j] += (*it)[j] == '1' ? 1 : 0;
-    }
-  }
-  double result = 0.0;
-  const int cycle_len = end - begin;
-  for (const auto count : v) {
-    assert(count <= cycle_len);
-    double p1 = (double)count / cycle_len;
-    assert(p1 <= 1.0);
-    assert(0.0 <= p1);
-    double p0 = 1.0 - p1;
-    assert(p0 <= 1.0);
-    assert(0.0 <= p0);
-
-    if (p0 != 0) { result -= p0 * std::log2(p0); }
-    if (p1 != 0) { result -= p1 * std::log2(p1); }
-  }
-  return result / num_nodes;
-}
-
 void usage(const char *argv0)
 {
   std::cerr << "Usage: " << argv0 << " graph states" << std::endl;
+  std::cerr << "   or: " << argv0 << " --generate_states=N graph" << std::endl;
   exit(1);
 }
 
 
-struct SimResult {
-  double entropy = 0.0;  // Shannon entropy.
-  int cycle_len = -1;
-  int max_steps = 0;
-  std::vector<int> num_live;
-};
-
-SimResult OneSimulation(GLife& glife)
-{
-  const int max_steps = absl::GetFlag(FLAGS_max_steps);
-  SimResult result;
-  std::vector<std::string> states_v;
-
-  // Simulate GOL
-  // Save intermediate states 
-  // 1. to detect cycle
-  absl::flat_hash_map<absl::string_view, int> states;
-
-  const bool print_states = absl::GetFlag(FLAGS_print_states);
-  const bool count_live = absl::GetFlag(FLAGS_count_live);
-  int cycle_begin = -1;
-  int cycle_end = -1;
-  int i;
-  for (i = 0; i < max_steps; ++i) {
-    const std::string state = glife.GetStateStr();
-    if (print_states) {
-      std::cout << std::setw(6) << i << ": " << state << std::endl;
-    }
-    const auto it = states.find(state);
-    const bool found = it != states.end();
-    if (!found) {
-      // A new state.
-      states_v.push_back(std::move(state));
-      auto &s = states_v.back();
-      states.insert({s, i});
-
-      if (count_live) {
-        result.num_live.push_back(std::count_if(
-            s.begin(), s.end(), [](char c) { return c == '1'; }));
-      }
-      glife.Update();
-    } else { 
-      cycle_begin = it->second;
-      // std::cout << "Finite path: " << it->second;
-      // std::cout << ", Cycle length: " << i - cycle_begin << " ";
-      cycle_end = i;
-
-      std::vector<std::string> cycle(
-          states_v.begin() + it->second, states_v.end());
-      while (states_v.size() < max_steps) {
-        states_v.insert(states_v.end(), cycle.begin(), cycle.end());
-      }
-      assert(states_v.size() >= max_steps);
-      states_v.resize(max_steps);
-      break;
-    }
-  }
-  result.max_steps = i;
-  double& entropy = result.entropy;
-  if (i == max_steps) {
-    // No cycle found within max_steps
-    // std::cout << "Finite path: unknown";
-    // std::cout << ", Cycle length: unknown" << std::endl;
-    entropy = ShannonEntropy(states_v.begin(), states_v.end());
-    // printf("Shannon entropy: %6.2f\n", shannon_entropy);
-  } else {
-    assert(cycle_begin != -1);
-    entropy = ShannonEntropy(states_v.begin() + cycle_begin,
-                             states_v.begin() + cycle_end);
-    result.cycle_len = cycle_end - cycle_begin;
-    // printf("Shannon entropy: %6.2f\n", shannon_entropy);
-  }
-  return result;
-}
-
 void SaveArgs(const std::string& outd, int argc, char *argv[])
 {
   const std::string outf = outd + "/invocation.txt";
@@ -168,14 +127,6 @@ void SaveArgs(const std::string& outd, int argc, char *argv[])
   }
 }
 
-void SaveTo(const std::string& outd, absl::string_view filename,
-            const std::string& contents)
-{
-  const auto csv = absl::StrCat(outd, "/", filename);
-  std::ofstream ofs(csv);
-  ofs << contents << std::endl;
-}
-
 std::string ConcatArgs(int argc, char *argv[]) 
 {
   absl::string_view argv0 = absl::StripPrefix(argv[0], "./");
@@ -186,46 +137,115 @@ std::string ConcatArgs(int argc, char *argv[])
   return absl::StrReplaceAll(result, {{"/", "_"}});
 }
 
-// Combine all results into a string suitable for importing
-// into Google sheet.
-std::string CombineAll(const std::vector<SimResult>& results)
+// Identifies the experiment a checkpoint or a shard belongs to: every
+// flag that changes the results, and the name, size and modification
+// time of the input files.
+uint64_t RunId(const std::string& graph_filename,
+               const std::string& states_filename)
 {
-  std::string result = "FinitePath,CycleLength,Entropy\n";
-  for (const auto& r : results) {
-    absl::StrAppend(
-        &result, r.max_steps, ",", r.cycle_len, ",", r.entropy, "\n");
+  std::string id;
+  auto add = [&id](absl::string_view name, const auto& value) {
+    absl::StrAppend(&id, name, "=", value, "\n");
+  };
+  auto add_double = [&add](absl::string_view name, double value) {
+    add(name, absl::StrFormat("%a", value));
+  };
+  for (const std::string& filename : {graph_filename, states_filename}) {
+    int64_t size = -1, mtime_ns = -1;
+    if (!filename.empty()) GraphSourceId(filename, &size, &mtime_ns);
+    add(filename, absl::StrCat(size, ",", mtime_ns));
   }
-  return result;
+  add("max_steps", absl::GetFlag(FLAGS_max_steps));
+  add("count_live", absl::GetFlag(FLAGS_count_live));
+  add("num_rewire", absl::GetFlag(FLAGS_num_rewire));
+  add("num_remove", absl::GetFlag(FLAGS_num_remove));
+  add("num_add", absl::GetFlag(FLAGS_num_add));
+  add("edit_seed", absl::GetFlag(FLAGS_edit_seed));
+  add("generate_states", absl::GetFlag(FLAGS_generate_states));
+  add_double("live_fraction", absl::GetFlag(FLAGS_live_fraction));
+  add("seed", absl::GetFlag(FLAGS_seed));
+  add_double("density_threshold", absl::GetFlag(FLAGS_density_threshold));
+  auto add_list = [&add](absl::string_view name,
+                         const std::vector<std::string>& value) {
+    add(name, absl::StrJoin(value, ","));
+  };
+  add_list("underpopulation", absl::GetFlag(FLAGS_underpopulation));
+  add_list("overpopulation", absl::GetFlag(FLAGS_overpopulation));
+  add_list("B", absl::GetFlag(FLAGS_B));
+  add_list("S", absl::GetFlag(FLAGS_S));
+  add_list("conway", absl::GetFlag(FLAGS_conway));
+  return CheckpointLog::Checksum(id.data(), id.size());
 }
 
-int main(int argc, char *argv[]) 
+// 'num_states' distinct random states, per --live_fraction and --seed.
+StatesFile GenerateStates(int num_vertices, int num_states)
 {
-  srand(time(NULL));
+  const double p = absl::GetFlag(FLAGS_live_fraction);
+  const int num_live = std::min<int>(num_vertices, std::ceil(p * num_vertices));
+  const StateGenerator generator(num_vertices, std::max(0, num_live),
+                                 absl::GetFlag(FLAGS_seed));
+  if (!generator.Enough(num_states)) {
+    std::cerr << "There are fewer than " << num_states << " states with "
+              << num_live << " of " << num_vertices << " vertices live"
+              << std::endl;
+    exit(1);
+  }
+  auto words = generator.Generate(num_states, absl::GetFlag(FLAGS_num_threads));
+  if (!words) {
+    std::cerr << "Could not generate " << num_states << " distinct states"
+              << std::endl;
+    exit(1);
+  }
+  return StatesFile(num_vertices, std::move(*words));
+}
 
+int main(int argc, char *argv[]) 
+{
   const auto args = absl::ParseCommandLine(argc, argv);
 
   // Input torus size and file to dump it to
   std::string graph_filename, states_filename;
 
-  if (args.size() == 3) {
+  const int generate_states = absl::GetFlag(FLAGS_generate_states);
+  if (args.size() == 3 && generate_states == 0) {
     graph_filename = args[1];
     states_filename = args[2];
+  } else if (args.size() == 2 && generate_states > 0) {
+    graph_filename = args[1];
   } else {
     usage(argv[0]);
   }
 
+  GLife::SetBinaryCache(absl::GetFlag(FLAGS_graph_cache));
   GLife zygote(graph_filename);
+  // ASCII or packed; see states_file.h.
+  const StatesFile states =
+      generate_states > 0 ? GenerateStates(zygote.NumVertices(),
+                                           generate_states)
+                          : StatesFile(states_filename);
+  if (!states.ok() || (states.num_states() > 0 &&
+                       states.num_vertices() != zygote.NumVertices())) {
+    std::cerr << argv[0] << ": " << states_filename << " is not a states file"
+              << " for " << graph_filename << std::endl;
+    exit(1);
+  }
+  Shard shard;
+  const std::string shard_spec = absl::GetFlag(FLAGS_shard);
+  if (!shard_spec.empty() && !ParseShard(shard_spec, &shard)) {
+    std::cerr << argv[0] << ": --shard must be i/N with 0 <= i < N"
+              << std::endl;
+    exit(1);
+  }
+  SimOptions options;
+  options.max_steps = absl::GetFlag(FLAGS_max_steps);
+  options.print_states = absl::GetFlag(FLAGS_print_states);
+  options.count_live = absl::GetFlag(FLAGS_count_live);
+  options.brent = absl::GetFlag(FLAGS_brent);
+  options.hashlife = absl::GetFlag(FLAGS_hashlife);
 
   const double density_threshold = absl::GetFlag(FLAGS_density_threshold);
   if (density_threshold > 0) {
-    zygote.SetNewStateFn([density_threshold](bool live, int num_neighbors,
-                                             int num_live_neighbors) {
-      const double density = (double) num_live_neighbors / num_neighbors;
-      if (density > density_threshold) {
-        return !live;
-      }
-      return live;
-    });
+    zygote.SetNewStateFn(DensityRule(density_threshold));
   }
   const auto underpop = absl::GetFlag(FLAGS_underpopulation);
   const auto overpop = absl::GetFlag(FLAGS_overpopulation);
@@ -239,14 +259,7 @@ int main(int argc, char *argv[])
     assert(underpop.size() == 2);
     int i0 = atoi(underpop[0].c_str());
     int i1 = atoi(underpop[1].c_str());
-    zygote.SetNewStateFn([i0, i1](bool live, int num_neighbors,
-                                  int num_live_neighbors) {
-      // Dead vertex becomes alive if it has at least i0 live neighbors.
-      // Live vertex remains alive if it has at least i1 live neighbors.
-      if (!live && num_live_neighbors >= i0) return true;
-      if (live && num_live_neighbors >= i1) return true;
-      return false;
-    });
+    zygote.SetNewStateFn(UnderpopulationRule(i0, i1));
   }
 
   if (!overpop.empty()) {
@@ -255,14 +268,7 @@ int main(int argc, char *argv[])
     assert(overpop.size() == 2);
     const int i0 = atoi(overpop[0].c_str());
     const int i1 = atoi(overpop[1].c_str());
-    zygote.SetNewStateFn([i0, i1](bool live, int num_neighbors,
-                                  int num_live_neighbors) {
-      // Dead vertex becomes alive if it has at least i0 live neighbors.
-      // Live vertex remains alive if it has at most i1 live neighbors.
-      if (!live && num_live_neighbors >= i0) return true;
-      if (live && num_live_neighbors <= i1) return true;
-      return false;
-    });
+    zygote.SetNewStateFn(OverpopulationRule(i0, i1));
   }
 
   if (!conway.empty()) {
@@ -270,56 +276,85 @@ int main(int argc, char *argv[])
     const int i0 = atoi(conway[0].c_str());
     const int i1 = atoi(conway[1].c_str());
     const int i2 = atoi(conway[2].c_str());
-
-    zygote.SetNewStateFn([i0, i1, i2](bool live, int num_neighbors,
-                                      int num_live_neighbors) {
-      // Dead vertex becomes alive if it has exactly i1 live neighbors.
-      if (num_live_neighbors == i1) return true;
-
-      // Dead if i0 or fewer or more than i2 neighbors.
-      if (num_live_neighbors <= i0 || num_live_neighbors > i2) return false;
-
-      // Otherwise remain in current state.
-      return live;
-    });
-
+    zygote.SetNewStateFn(ConwayRule(i0, i1, i2));
   }
 
   if (!B.empty() && !S.empty()) {
     std::vector<int> b, s;
     for (const auto& str : B) b.push_back(atoi(str.c_str()));
     for (const auto& str : S) s.push_back(atoi(str.c_str()));
-
-    zygote.SetNewStateFn(
-        [b = std::move(b), s = std::move(s)](bool live,
-                                            int num_neighbors,
-                                            int num_live_neighbors) mutable {
-      if (!live &&
-          std::find(b.begin(), b.end(), num_live_neighbors) != b.end()) {
-        return true;
-      }
-      if (live &&
-          std::find(s.begin(), s.end(), num_live_neighbors) != s.end()) {
-        return true;
-      }
-      return false;
-    });
+    zygote.SetNewStateFn(BirthSurviveRule(std::move(b), std::move(s)));
   }
 
+  zygote.SetIncremental(absl::GetFlag(FLAGS_incremental));
+  zygote.SetUpdateThreads(absl::GetFlag(FLAGS_update_threads));
+
   const auto verbose = absl::GetFlag(FLAGS_verbose);
 
   const int num_rewire = absl::GetFlag(FLAGS_num_rewire);
   const int num_remove = absl::GetFlag(FLAGS_num_remove);
   const int num_add = absl::GetFlag(FLAGS_num_add);
+  if (absl::GetFlag(FLAGS_edit_seed) != 0) {
+    SeedThreadRng(absl::GetFlag(FLAGS_edit_seed));
+  }
+  if (absl::GetFlag(FLAGS_log_edits)) GLife::SetEditLog(&std::cerr);
   if (num_rewire > 0) {
-    zygote.ReWire(num_rewire);
+    const int done = zygote.ReWire(num_rewire);
+    if (done < num_rewire) {
+      std::cerr << argv[0] << ": found a valid swap for only " << done
+                << " of " << num_rewire << " rewirings" << std::endl;
+      exit(1);
+    }
   } else if (num_remove > 0) {
     zygote.RemoveEdges(num_remove);
   } else if (num_add > 0) {
-    zygote.AddEdges(num_remove);
+    zygote.AddEdges(num_add);
+  }
+
+  if (const std::string spec = absl::GetFlag(FLAGS_reorder); !spec.empty()) {
+    VertexOrder order;
+    if (!ParseVertexOrder(spec, &order)) {
+      std::cerr << argv[0] << ": unknown --reorder " << spec << std::endl;
+      exit(1);
+    }
+    if (!zygote.Reorder(order)) {
+      std::cerr << argv[0] << ": --reorder " << spec
+                << " needs vertices named i_j" << std::endl;
+      exit(1);
+    }
+  }
+
+  if (options.hashlife &&
+      (!CanUseHashlife(zygote) || absl::GetFlag(FLAGS_multi_trial))) {
+    std::cerr << argv[0] << ": --hashlife needs an unedited torus whose size"
+              << " is a power of two, and no --multi_trial or --reorder"
+              << std::endl;
+    exit(1);
+  }
+
+  std::unique_ptr<OutcomeMemo> memo;
+  if (absl::GetFlag(FLAGS_memo_mb) > 0) {
+    memo = std::make_unique<OutcomeMemo>((size_t{1} << 20) *
+                                         absl::GetFlag(FLAGS_memo_mb));
+    options.memo = memo.get();
+  }
+
+  // Shards must all simulate the same edited graph.
+  const bool edited = num_rewire > 0 || num_remove > 0 || num_add > 0;
+  if (!shard_spec.empty() && edited && absl::GetFlag(FLAGS_edit_seed) == 0) {
+    std::cerr << argv[0] << ": --shard needs --edit_seed to edit the graph"
+              << " the same way in every shard" << std::endl;
+    exit(1);
   }
 
   std::string outd = absl::GetFlag(FLAGS_output_dir);
+  const bool resume = absl::GetFlag(FLAGS_resume);
+  if (resume && (outd.empty() || absl::GetFlag(FLAGS_checkpoint_secs) <= 0 ||
+                 (edited && absl::GetFlag(FLAGS_edit_seed) == 0))) {
+    std::cerr << argv[0] << ": --resume needs --output_dir, checkpoints and,"
+              << " to edit the graph the same way, --edit_seed" << std::endl;
+    exit(1);
+  }
   if (outd.empty()) {
     outd = "results___" + ConcatArgs(argc, argv) + std::to_string(time(NULL));
   }
@@ -334,7 +369,7 @@ int main(int argc, char *argv[])
 
   if (num_rewire > 0 || num_remove > 0 || num_add > 0) {
     std::string out_graph = outd + "/" + graph_filename;
-    zygote.DumpToJSON(out_graph);
+    zygote.DumpToJSON(out_graph, absl::GetFlag(FLAGS_compact_json));
     if (num_rewire > 0) {
       std::cerr << "Wrote " << out_graph << " with " << num_rewire << " rewirings" << std::endl;
     } else if (num_remove > 0) {
@@ -345,79 +380,111 @@ int main(int argc, char *argv[])
   }
 
   const int num_threads = absl::GetFlag(FLAGS_num_threads);
-  std::vector<SimResult> results;
 
   auto start = std::chrono::steady_clock::now();
-  std::ifstream ifs(states_filename);
-
-  int prev_report = 0;
-  bool done = false;
-  while (!done) {
-    std::vector<std::future<SimResult>> futures;
-    for (int j = 0; j < num_threads; j++) {
-      std::string state;
-      ifs >> state;
-      if (ifs.eof()) {
-        done = true;
-        break;
-      }
-    
-      auto future = std::async(std::launch::async,
-                               [state = std::move(state), &zygote]() {
-                                 GLife glife(zygote);
-                                 glife.SetState(state);
-                                 return OneSimulation(glife);
-                               });
-      futures.push_back(std::move(future));
+
+  // One slot per state of this shard, in input order. Workers fill them
+  // in as they finish.
+  const int num_states = shard.NumStates(states.num_states());
+  std::vector<SimResult> results(num_states);
+  // Results already in the checkpoint, when resuming.
+  std::vector<char> done(num_states);
+  std::unique_ptr<CheckpointLog> checkpoint;
+  if (absl::GetFlag(FLAGS_checkpoint_secs) > 0) {
+    checkpoint =
+        std::make_unique<CheckpointLog>(absl::GetFlag(FLAGS_checkpoint_secs));
+    CheckpointHeader run = {};
+    run.max_steps = options.max_steps;
+    run.num_results = num_states;
+    run.num_states = states.num_states();
+    run.shard_index = shard.index;
+    run.shard_count = shard.count;
+    run.run_id = RunId(graph_filename, states_filename);
+    std::string error;
+    if (!checkpoint->Open(outd + "/checkpoint.log", run, resume, &results,
+                          &done, &error)) {
+      std::cerr << argv[0] << ": " << error << std::endl;
+      exit(1);
     }
-    for (auto& future : futures) {
-      results.push_back(future.get());
+    if (verbose && resume) {
+      std::cerr << std::count(done.begin(), done.end(), 1) << " of "
+                << num_states << " states done before" << std::endl;
     }
-
-    if (verbose) {
-      const size_t count_states = results.size();
-      if (count_states / 100 > prev_report) {
-        prev_report = count_states / 100;
-        auto end = std::chrono::steady_clock::now();
-        std::cerr << std::setw(4) << count_states << " Elapsed time in milliseconds: "
-          << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-          << " ms" << std::endl;
-        start = end;
+  }
+  if (absl::GetFlag(FLAGS_multi_trial)) {
+    if (options.print_states || options.count_live) {
+      std::cerr << argv[0] << ": --multi_trial does not support --print_states"
+                << " or --count_live" << std::endl;
+      exit(1);
+    }
+    // One GLifeMulti per thread, each taking the next state as its lanes
+    // free up.
+    std::atomic<int> next_state = 0;
+    auto next = [&](const uint64_t** state) -> SimResult* {
+      int i = next_state++;
+      while (i < num_states && done[i]) i = next_state++;
+      if (i >= num_states) return nullptr;
+      *state = states.State(shard.StateIndex(i));
+      return &results[i];
+    };
+    auto finished = [&](SimResult* result) {
+      if (checkpoint) checkpoint->Add(result - results.data(), *result);
+    };
+    WorkStealingPool pool(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+      pool.Submit([&]() {
+        RunMultiTrial(zygote, options.max_steps, next, finished);
+      });
+    }
+  } else {
+    std::atomic<int> num_done = 0;
+    int prev_report = 0;
+    WorkStealingPool pool(num_threads);
+    // Each task simulates a few states on one copy of the zygote, which
+    // shares its topology and only owns the state.
+    const int chunk = 16;
+    for (int begin = 0; begin < num_states; begin += chunk) {
+      const int end = std::min(begin + chunk, num_states);
+      // Keep a few tasks per thread queued, and no more.
+      pool.WaitUntilAtMost(4 * num_threads);
+      pool.Submit([begin, end, &states, &shard, &zygote, &options, &results,
+                   &done, &checkpoint, &num_done]() {
+        GLife glife(zygote);
+        for (int i = begin; i < end; ++i) {
+          if (done[i]) continue;
+          glife.SetState(states.State(shard.StateIndex(i)));
+          results[i] = Simulate(glife, options);
+          if (checkpoint) checkpoint->Add(i, results[i]);
+          num_done += 1;
+        }
+      });
+
+      if (verbose) {
+        const int count_states = num_done;
+        if (count_states / 100 > prev_report) {
+          prev_report = count_states / 100;
+          auto end = std::chrono::steady_clock::now();
+          std::cerr << std::setw(4) << count_states << " Elapsed time in milliseconds: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+            << " ms" << std::endl;
+          start = end;
+        }
       }
     }
+    pool.Wait();
   }
-
-  std::array<int, 1001> histogram = {};
-  for (const auto& result: results) {
-    int bucket_index = (int)(result.entropy / 0.001);
-    assert(bucket_index < histogram.size());
-    histogram[bucket_index] += 1;
+  if (checkpoint && !checkpoint->Close()) {
+    std::cerr << argv[0] << ": checkpoints were incomplete" << std::endl;
   }
-
-  SaveTo(outd, "entropy_histogram.csv", absl::StrJoin(histogram, ","));
-  SaveTo(outd, "entropy.csv", absl::StrJoin(results, ",",
-                                            [](std::string *out, const SimResult& r) {
-                                                absl::StrAppend(out, r.entropy);
-                                            }));
-  SaveTo(outd, "max_steps.csv", absl::StrJoin(results, ",",
-                                              [](std::string *out, const SimResult& r) {
-                                                  absl::StrAppend(out, r.max_steps);
-                                              }));
-  SaveTo(outd, "cycle_len.csv", absl::StrJoin(results, ",",
-                                              [](std::string *out, const SimResult& r) {
-                                                  absl::StrAppend(out, r.cycle_len);
-                                              }));
-
-  SaveTo(outd, "combined.csv", CombineAll(results));
-
-  if (!results.empty() && !results[0].num_live.empty()) {
-    std::string str;
-    for (const auto &r : results) {
-      absl::StrAppend(&str, absl::StrJoin(r.num_live, ","), "\n");
-    }
-    str.resize(str.size() - 1);
-    SaveTo(outd, "num_live.csv", str);
+  SaveResults(outd, results);
+  if (!shard_spec.empty() &&
+      !WriteShardInfo(outd, shard, states.num_states(),
+                      RunId(graph_filename, states_filename))) {
+    std::cerr << argv[0] << ": could not write " << outd << "/shard.txt"
+              << std::endl;
+    exit(1);
   }
+  profile::WriteProfile(outd + "/profile.json");
 
   return 0;
 }
@@ -0,0 +1,72 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+
+// Splitting one states file across processes: "shannon2 --shard=i/N"
+// simulates states i, i + N, i + 2N, ... only, and shardmerge combines
+// the outputs of shards 0 to N - 1 into those of a single run.
+//
+// Each finished shard writes shard.txt into its output directory, after
+// its results, so a directory without one holds a shard to run again.
+// It also identifies the run, so that shardmerge only combines shards
+// of the same experiment.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <string>
+
+struct Shard {
+  int index = 0;
+  int count = 1;
+
+  // Number of the 'num_states' states in this shard.
+  int NumStates(int num_states) const {
+    return num_states <= index ? 0 : (num_states - index - 1) / count + 1;
+  }
+
+  // Index in the states file of the k-th state of this shard.
+  int StateIndex(int k) const { return index + k * count; }
+};
+
+// "i/N", 0 <= i < N.
+inline bool ParseShard(const std::string& spec, Shard* shard) {
+  int index, count;
+  char end;
+  if (sscanf(spec.c_str(), "%d/%d%c", &index, &count, &end) != 2 ||
+      count < 1 || index < 0 || index >= count) {
+    return false;
+  }
+  *shard = {index, count};
+  return true;
+}
+
+// Record in 'outd' that it holds the complete results of 'shard' of
+// 'num_states' states, from the run identified by 'run_id' (see RunId()
+// in shannon2).
+inline bool WriteShardInfo(const std::string& outd, const Shard& shard,
+                           int num_states, uint64_t run_id) {
+  std::ofstream ofs(outd + "/shard.txt");
+  ofs << "shard " << shard.index << "/" << shard.count << "\n"
+      << "states " << num_states << "\n"
+      << "run " << run_id << "\n";
+  ofs.close();
+  return bool(ofs);
+}
+
+// Read what WriteShardInfo() wrote; false if 'outd' has no complete
+// shard.
+inline bool ReadShardInfo(const std::string& outd, Shard* shard,
+                          int* num_states, uint64_t* run_id) {
+  std::ifstream ifs(outd + "/shard.txt");
+  std::string shard_word, spec, states_word, run_word;
+  if (!(ifs >> shard_word >> spec >> states_word >> *num_states >>
+        run_word >> *run_id) ||
+      shard_word != "shard" || states_word != "states" ||
+      run_word != "run" || *num_states < 0) {
+    return false;
+  }
+  return ParseShard(spec, shard);
+}
+
+#endif  // SHARD_H_
@@ -0,0 +1,188 @@
+// Merge the outputs of "shannon2 --shard=i/N" for i = 0 .. N-1 into
+// those of a single run over the whole states file (see shard.h).
+//
+// Usage: ./shardmerge output-dir shard-dir...
+//
+// The shard directories may be given in any order. Results are merged
+// as text, so the merged files are byte for byte what one run writes.
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "shard.h"
+
+void usage(const char *argv0)
+{
+  std::cerr << "Usage: " << argv0 << " output-dir shard-dir..." << std::endl;
+  exit(1);
+}
+
+void Fail(const std::string& what)
+{
+  std::cerr << "shardmerge: " << what << std::endl;
+  exit(1);
+}
+
+// The contents of 'filename' without trailing newlines. False if it
+// cannot be read.
+bool ReadFile(const std::string& filename, std::string* contents)
+{
+  std::ifstream ifs(filename);
+  if (!ifs) return false;
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  *contents = ss.str();
+  while (!contents->empty() && contents->back() == '\n') contents->pop_back();
+  return true;
+}
+
+// As SaveTo() in simulate.h.
+void WriteFile(const std::string& outd, const std::string& filename,
+               const std::string& contents)
+{
+  std::ofstream ofs(outd + "/" + filename);
+  ofs << contents << std::endl;
+  if (!ofs) Fail("could not write " + outd + "/" + filename);
+}
+
+struct ShardDir {
+  std::string dir;
+  Shard shard;
+  // States in the shard.
+  int size = 0;
+};
+
+// Split 'filename' of every shard at 'sep' into one item per state,
+// skipping 'header' items first, and interleave the items back into
+// states file order. Empty shards need not have the file.
+std::vector<std::string> Interleave(const std::vector<ShardDir>& shards,
+                                    int num_states,
+                                    const std::string& filename, char sep,
+                                    int header = 0)
+{
+  std::vector<std::string> items(num_states);
+  for (const ShardDir& s : shards) {
+    if (s.size == 0) continue;
+    const std::string path = s.dir + "/" + filename;
+    std::string contents;
+    if (!ReadFile(path, &contents)) Fail("cannot read " + path);
+    std::vector<std::string> parts;
+    if (!contents.empty()) parts = absl::StrSplit(contents, sep);
+    if (parts.size() < header) Fail(path + " is truncated");
+    parts.erase(parts.begin(), parts.begin() + header);
+    if (parts.size() != s.size) {
+      Fail(path + " has " + std::to_string(parts.size()) + " entries, not " +
+           std::to_string(s.size));
+    }
+    for (int k = 0; k < s.size; ++k) {
+      items[s.shard.StateIndex(k)] = std::move(parts[k]);
+    }
+  }
+  return items;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3) usage(argv[0]);
+  const std::string outd = argv[1];
+
+  std::vector<ShardDir> shards;
+  int num_states = -1;
+  int count = -1;
+  uint64_t run_id = 0;
+  for (int a = 2; a < argc; ++a) {
+    ShardDir s;
+    s.dir = argv[a];
+    int total;
+    uint64_t id;
+    if (!ReadShardInfo(s.dir, &s.shard, &total, &id)) {
+      Fail(s.dir + " holds no finished shard");
+    }
+    if (num_states < 0) {
+      num_states = total;
+      count = s.shard.count;
+      run_id = id;
+    }
+    // The run id covers the rule, the graph and its edits, and the
+    // states; input files must keep their size and modification time,
+    // e.g. when copied to other machines.
+    if (total != num_states || s.shard.count != count || id != run_id) {
+      Fail(s.dir + " is a shard of another run");
+    }
+    s.size = s.shard.NumStates(num_states);
+    shards.push_back(s);
+  }
+  std::vector<std::string> seen(count);
+  for (const ShardDir& s : shards) {
+    if (!seen[s.shard.index].empty()) {
+      Fail(s.dir + " and " + seen[s.shard.index] + " are both shard " +
+           std::to_string(s.shard.index));
+    }
+    seen[s.shard.index] = s.dir;
+  }
+  for (int i = 0; i < count; ++i) {
+    if (seen[i].empty()) {
+      Fail("shard " + std::to_string(i) + "/" + std::to_string(count) +
+           " is missing");
+    }
+  }
+
+  if (0 != mkdir(outd.c_str(), 0777) && errno != EEXIST) {
+    Fail("mkdir(" + outd + "): " + strerror(errno));
+  }
+
+  std::array<int64_t, 1001> histogram = {};
+  for (const ShardDir& s : shards) {
+    const std::string path = s.dir + "/entropy_histogram.csv";
+    std::string contents;
+    if (!ReadFile(path, &contents)) Fail("cannot read " + path);
+    const std::vector<std::string> buckets = absl::StrSplit(contents, ',');
+    if (buckets.size() != histogram.size()) Fail(path + " is malformed");
+    for (int b = 0; b < buckets.size(); ++b) {
+      int64_t n;
+      if (!absl::SimpleAtoi(buckets[b], &n)) Fail(path + " is malformed");
+      histogram[b] += n;
+    }
+  }
+  WriteFile(outd, "entropy_histogram.csv", absl::StrJoin(histogram, ","));
+
+  for (const char* csv : {"entropy.csv", "max_steps.csv", "cycle_len.csv"}) {
+    WriteFile(outd, csv,
+              absl::StrJoin(Interleave(shards, num_states, csv, ','), ","));
+  }
+
+  std::string combined = "FinitePath,CycleLength,Entropy\n";
+  for (const std::string& line :
+       Interleave(shards, num_states, "combined.csv", '\n', 1)) {
+    absl::StrAppend(&combined, line, "\n");
+  }
+  WriteFile(outd, "combined.csv", combined);
+
+  // Only written with --count_live, and not by empty shards.
+  bool count_live = false;
+  for (const ShardDir& s : shards) {
+    struct stat st;
+    if (s.size > 0 && stat((s.dir + "/num_live.csv").c_str(), &st) == 0) {
+      count_live = true;
+    }
+  }
+  if (count_live) {
+    WriteFile(outd, "num_live.csv",
+              absl::StrJoin(
+                  Interleave(shards, num_states, "num_live.csv", '\n'),
+                  "\n"));
+  }
+  return 0;
+}
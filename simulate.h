@@ -0,0 +1,401 @@
+#ifndef SIMULATE_H_
+#define SIMULATE_H_
+
+// Running one initial state to a cycle, and saving the results of many,
+// as shared by the shannon2 and sweep drivers.
+
+#include <array>
+#include <assert.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "brent.h"
+#include "entropy.h"
+#include "glife.h"
+#include "glife_multi.h"
+#include "hashlife.h"
+#include "outcome_memo.h"
+
+struct SimOptions {
+  int max_steps = 4000;
+  // Print each state in evolution.
+  bool print_states = false;
+  // Count live cells in each generation.
+  bool count_live = false;
+  // Detect cycles with Brent's algorithm.
+  bool brent = false;
+  // Simulate with Hashlife; the graph must be a GTorus whose size is a
+  // power of two (see CanUseHashlife()).
+  bool hashlife = false;
+  // Outcomes shared between simulations of the same graph and rule, or
+  // null. Only used by OneSimulation(), without print_states and
+  // count_live.
+  OutcomeMemo* memo = nullptr;
+};
+
+struct SimResult {
+  double entropy = 0.0;  // Shannon entropy.
+  int cycle_len = -1;
+  int max_steps = 0;
+  std::vector<int> num_live;
+};
+
+inline SimResult OneSimulation(GLife& glife, const SimOptions& options)
+{
+  const int max_steps = options.max_steps;
+  SimResult result;
+
+  // Simulate GOL
+  // Save intermediate states to detect cycle.
+  absl::flat_hash_map<GLife::State, int> states;
+  // Entropy is accumulated as states are produced.
+  EntropyAccumulator entropy(glife);
+
+  const bool print_states = options.print_states;
+  const bool count_live = options.count_live;
+  // The memo answers for the whole trajectory, so it is of no use when
+  // every state is wanted.
+  OutcomeMemo* const memo =
+      print_states || count_live ? nullptr : options.memo;
+  // Keys of the states so far, to record their outcomes.
+  std::vector<StateKey> keys;
+  bool lookup = memo != nullptr;
+  // Set when a state of this trajectory is on a recorded cycle.
+  std::optional<OutcomeMemo::Outcome> on_cycle;
+  int cycle_begin = -1;
+  int i;
+  for (i = 0; i < max_steps; ++i) {
+    const GLife::State& state = glife.GetState();
+    if (print_states) {
+      std::cout << std::setw(6) << i << ": " << glife.GetStateStr() << std::endl;
+    }
+    GLIFE_PROFILE_COUNT(kStateHashProbes, 1);
+    const auto [it, inserted] = [&] {
+      GLIFE_PROFILE_SCOPE(kStateHash);
+      return states.insert({state, i});
+    }();
+    if (inserted) {
+      // A new state.
+      if (memo != nullptr) keys.push_back(KeyOf(state));
+      OutcomeMemo::Outcome known;
+      if (lookup && memo->Find(keys.back(), &known)) {
+        lookup = false;
+        // The trajectory joins a recorded one here. The states before
+        // this one are all transient, unless it is on the cycle and the
+        // one before it is its predecessor there.
+        const bool entered_here = known.remaining > 0 || i == 0 ||
+                                  !(keys[i - 1] == known.cycle_pred);
+        const int begin = i + known.remaining;
+        if (entered_here && begin + known.cycle_len < max_steps) {
+          result.cycle_len = known.cycle_len;
+          result.max_steps = begin + known.cycle_len;
+          result.entropy = known.entropy;
+          keys.pop_back();
+          memo->Record(keys, begin, known.cycle_len, known.entropy);
+          return result;
+        }
+        // Keep going to find where the trajectory entered the cycle; the
+        // entropy is known. Or, if the cycle closes too late to be found,
+        // simulate max_steps states as usual.
+        if (!entered_here) on_cycle = known;
+      }
+      entropy.Add(state);
+      if (count_live) {
+        result.num_live.push_back(glife.NumLive());
+      }
+      glife.Update();
+    } else { 
+      cycle_begin = it->second;
+      break;
+    }
+  }
+  result.max_steps = i;
+  if (i == max_steps) {
+    // No cycle found within max_steps
+    result.entropy = entropy.Entropy();
+  } else {
+    assert(cycle_begin != -1);
+    // 'glife' is back at the first state of the cycle: go around it once
+    // more to count just the cycle states.
+    result.cycle_len = i - cycle_begin;
+    if (on_cycle) {
+      assert(on_cycle->cycle_len == result.cycle_len);
+      result.entropy = on_cycle->entropy;
+    } else {
+      entropy.Checkpoint();
+      for (int j = 0; j < result.cycle_len; ++j) {
+        entropy.Add(glife.GetState());
+        glife.Update();
+      }
+      result.entropy = entropy.EntropySinceCheckpoint();
+    }
+    if (memo != nullptr) {
+      memo->Record(keys, cycle_begin, result.cycle_len, result.entropy);
+    }
+  }
+  return result;
+}
+
+// Same as OneSimulation(), but finds the cycle with Brent's algorithm
+// and then replays the part of the trajectory the results need, so
+// memory does not grow with the number of steps. Without a cycle the
+// entropy is taken during the search, and only print_states or
+// count_live need a replay.
+inline SimResult OneSimulationBrent(GLife& glife, const SimOptions& options)
+{
+  const int max_steps = options.max_steps;
+  const bool print_states = options.print_states;
+  const bool count_live = options.count_live;
+  const bool replay_all = print_states || count_live;
+  SimResult result;
+
+  const GLife::State start = glife.GetState();
+  EntropyAccumulator entropy(glife);
+  const auto cycle =
+      FindCycleBrent(glife, max_steps, replay_all ? nullptr : &entropy);
+  if (!cycle && !replay_all) {
+    result.max_steps = max_steps;
+    result.entropy = entropy.Entropy();
+    return result;
+  }
+  // Entropy is computed over states [window_begin, result.max_steps).
+  int window_begin = 0;
+  if (cycle) {
+    window_begin = cycle->transient;
+    result.cycle_len = cycle->cycle_len;
+    result.max_steps = cycle->transient + cycle->cycle_len;
+  } else {
+    result.max_steps = max_steps;
+  }
+
+  // On a cycle 'glife' is already at its first state; otherwise replay
+  // from the start.
+  int first = window_begin;
+  if (!cycle || replay_all) {
+    glife.SetState(start);
+    first = 0;
+  }
+  int i;
+  for (i = first; i < result.max_steps; ++i) {
+    if (print_states) {
+      std::cout << std::setw(6) << i << ": " << glife.GetStateStr() << std::endl;
+    }
+    if (count_live) {
+      result.num_live.push_back(glife.NumLive());
+    }
+    if (i == window_begin) {
+      entropy.Checkpoint();
+    }
+    entropy.Add(glife.GetState());
+    glife.Update();
+  }
+  if (print_states && cycle) {
+    // The first repeated state.
+    std::cout << std::setw(6) << i << ": " << glife.GetStateStr() << std::endl;
+  }
+  result.entropy = entropy.EntropySinceCheckpoint();
+  return result;
+}
+
+// True if 'glife' is simulated by the torus kernel on an n x n torus
+// with n a power of two, which is what Hashlife runs on.
+inline bool CanUseHashlife(const GLife& glife)
+{
+  const auto& torus = glife.Topology()->Torus();
+  return torus && torus->size() >= 4 && (torus->size() & (torus->size() - 1)) == 0;
+}
+
+// The calling thread's Hashlife for the torus and rule of 'kernel'. Its
+// nodes and memoized results carry over from one simulation to the next
+// until they pass 'max_nodes'.
+inline Hashlife& ThreadHashlife(const GTorusKernel& kernel,
+                                size_t max_nodes = size_t{1} << 22)
+{
+  thread_local std::unique_ptr<Hashlife> hashlife;
+  if (!hashlife || hashlife->size() != kernel.size() ||
+      hashlife->birth() != kernel.birth() ||
+      hashlife->survive() != kernel.survive() ||
+      hashlife->NumNodes() > max_nodes) {
+    hashlife.reset();
+    hashlife = std::make_unique<Hashlife>(kernel.size(), kernel.birth(),
+                                          kernel.survive());
+  }
+  return *hashlife;
+}
+
+// Same as OneSimulationBrent(), on Hashlife: the cycle search compares
+// canonical nodes, and the trajectory is only replayed over the states
+// the results need, jumping straight to the start of the cycle.
+// Leaves 'glife' at its initial state.
+inline SimResult OneSimulationHashlife(GLife& glife, const SimOptions& options)
+{
+  assert(CanUseHashlife(glife));
+  const int max_steps = options.max_steps;
+  const bool print_states = options.print_states;
+  const bool count_live = options.count_live;
+  SimResult result;
+
+  Hashlife& hashlife = ThreadHashlife(*glife.Topology()->Torus());
+  const GLife::State start = glife.GetState();
+  const Hashlife::Node start_node = hashlife.FromState(start.data());
+  const auto cycle = FindCycleHashlife(hashlife, start_node, max_steps);
+  // Entropy is computed over states [window_begin, result.max_steps).
+  int window_begin = 0;
+  if (cycle) {
+    window_begin = cycle->transient;
+    result.cycle_len = cycle->cycle_len;
+    result.max_steps = cycle->transient + cycle->cycle_len;
+  } else {
+    result.max_steps = max_steps;
+  }
+
+  int first = window_begin;
+  if (!cycle || print_states || count_live) first = 0;
+  Hashlife::Node node = hashlife.Advance(start_node, first);
+  GLife::State state;
+  auto print = [&](int i) {
+    hashlife.ToState(node, &state);
+    glife.SetState(state);
+    std::cout << std::setw(6) << i << ": " << glife.GetStateStr() << std::endl;
+  };
+  EntropyAccumulator entropy(glife);
+  std::vector<int> live;
+  int i;
+  for (i = first; i < result.max_steps; ++i) {
+    if (print_states) print(i);
+    if (count_live) {
+      result.num_live.push_back(hashlife.NumLive(node));
+    }
+    if (i == window_begin) {
+      entropy.Checkpoint();
+    }
+    live.clear();
+    hashlife.LiveCells(node, &live);
+    entropy.AddLive(live);
+    node = hashlife.Step(node, 0);
+  }
+  if (print_states && cycle) {
+    // The first repeated state.
+    print(i);
+  }
+  if (print_states) glife.SetState(start);
+  result.entropy = entropy.EntropySinceCheckpoint();
+  return result;
+}
+
+inline SimResult Simulate(GLife& glife, const SimOptions& options)
+{
+  GLIFE_PROFILE_SCOPE(kSimulate);
+  GLIFE_PROFILE_COUNT(kSimulations, 1);
+  if (options.hashlife) return OneSimulationHashlife(glife, options);
+  return options.brent ? OneSimulationBrent(glife, options)
+                       : OneSimulation(glife, options);
+}
+
+// Run states on one GLifeMulti, 64 at a time, refilling lanes as soon
+// as they finish. 'next' provides the next state, as GLife::State words,
+// and the slot its result goes to, or returns nullptr when there are no
+// more; it is called from this thread only. 'finished', if given, is
+// called here with each slot once its result is in. print_states and
+// count_live are not supported.
+inline void RunMultiTrial(
+    const GLife& zygote, int max_steps,
+    const std::function<SimResult*(const uint64_t**)>& next,
+    const std::function<void(SimResult*)>& finished = nullptr)
+{
+  GLifeMulti multi(zygote, max_steps);
+  std::vector<GLifeMulti::Result> done;
+  // Result slots, by GLifeMulti id.
+  std::vector<SimResult*> slots;
+  bool more = true;
+  while (true) {
+    while (more && multi.HasFreeLane()) {
+      const uint64_t* state;
+      SimResult* slot = next(&state);
+      more = slot != nullptr;
+      if (more) {
+        multi.Start(slots.size(), state);
+        slots.push_back(slot);
+      }
+    }
+    if (multi.Idle()) break;
+    multi.Step(&done);
+    for (const auto& r : done) {
+      SimResult& result = *slots[r.id];
+      result.entropy = r.entropy;
+      result.cycle_len = r.cycle_len;
+      result.max_steps = r.max_steps;
+      if (finished) finished(&result);
+    }
+    done.clear();
+  }
+}
+
+inline void SaveTo(const std::string& outd, absl::string_view filename,
+                   const std::string& contents)
+{
+  const auto csv = absl::StrCat(outd, "/", filename);
+  std::ofstream ofs(csv);
+  ofs << contents << std::endl;
+}
+
+// Combine all results into a string suitable for importing
+// into Google sheet.
+inline std::string CombineAll(const std::vector<SimResult>& results)
+{
+  std::string result = "FinitePath,CycleLength,Entropy\n";
+  for (const auto& r : results) {
+    absl::StrAppend(
+        &result, r.max_steps, ",", r.cycle_len, ",", r.entropy, "\n");
+  }
+  return result;
+}
+
+// Write the entropy histogram, the per-state CSV files and, if live
+// cells were counted, num_live.csv into directory 'outd'.
+inline void SaveResults(const std::string& outd,
+                        const std::vector<SimResult>& results)
+{
+  GLIFE_PROFILE_SCOPE(kSaveResults);
+  std::array<int, 1001> histogram = {};
+  for (const auto& result: results) {
+    int bucket_index = (int)(result.entropy / 0.001);
+    assert(bucket_index < histogram.size());
+    histogram[bucket_index] += 1;
+  }
+
+  SaveTo(outd, "entropy_histogram.csv", absl::StrJoin(histogram, ","));
+  SaveTo(outd, "entropy.csv", absl::StrJoin(results, ",",
+                                            [](std::string *out, const SimResult& r) {
+                                                absl::StrAppend(out, r.entropy);
+                                            }));
+  SaveTo(outd, "max_steps.csv", absl::StrJoin(results, ",",
+                                              [](std::string *out, const SimResult& r) {
+                                                  absl::StrAppend(out, r.max_steps);
+                                              }));
+  SaveTo(outd, "cycle_len.csv", absl::StrJoin(results, ",",
+                                              [](std::string *out, const SimResult& r) {
+                                                  absl::StrAppend(out, r.cycle_len);
+                                              }));
+
+  SaveTo(outd, "combined.csv", CombineAll(results));
+
+  if (!results.empty() && !results[0].num_live.empty()) {
+    std::string str;
+    for (const auto &r : results) {
+      absl::StrAppend(&str, absl::StrJoin(r.num_live, ","), "\n");
+    }
+    str.resize(str.size() - 1);
+    SaveTo(outd, "num_live.csv", str);
+  }
+}
+
+#endif  // SIMULATE_H_
@@ -0,0 +1,169 @@
+#ifndef STATE_GEN_H_
+#define STATE_GEN_H_
+
+// Random initial states with exactly 'num_live' live vertices.
+//
+// Candidate i is drawn from Rng(seed, i) by Floyd's algorithm, which
+// picks the live vertices in O(num_live) steps. The states generated are
+// the first 'num_states' distinct candidates, told apart by a 128-bit
+// fingerprint, so the output depends on the seed only; num_threads just
+// sets how many candidates are examined at once.
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "ggen.h"
+#include "rng.h"
+
+class StateGenerator {
+ public:
+  StateGenerator(int num_vertices, int num_live, uint64_t seed)
+      : num_vertices_(num_vertices), num_live_(num_live), seed_(seed) {
+    assert(0 <= num_live && num_live <= num_vertices);
+  }
+
+  int words_per_state() const { return (num_vertices_ + 63) / 64; }
+
+  // Write candidate 'index' to 'words', laid out as a GLife::State.
+  void Candidate(int64_t index, uint64_t* words) const {
+    std::fill(words, words + words_per_state(), 0);
+    Rng rng(seed_, index);
+    for (int j = num_vertices_ - num_live_; j < num_vertices_; ++j) {
+      const int t = rng.Below(j + 1);
+      const int v = IsSet(words, t) ? j : t;
+      words[v >> 6] |= uint64_t{1} << (v & 63);
+    }
+  }
+
+  // True if there are at least 'num_states' distinct states. Exact:
+  // C(num_vertices, num_live) is built up one factor at a time and only
+  // until it reaches num_states, so it never overflows.
+  bool Enough(int num_states) const {
+    const uint64_t wanted = std::max(num_states, 0);
+    const int k = std::min(num_live_, num_vertices_ - num_live_);
+    // C(num_vertices - k + i, i) after step i, below 2^62.
+    uint64_t count = 1;
+    for (int i = 1; i <= k && count < wanted; ++i) {
+      count = count * (num_vertices_ - k + i) / i;
+    }
+    return count >= wanted;
+  }
+
+  // The indices of the first 'num_states' distinct candidates, in
+  // increasing order, or nullopt if they did not turn up within many
+  // times the expected number of candidates, which only happens if
+  // candidates are not as random as they should be. Requires
+  // Enough(num_states).
+  std::optional<std::vector<int64_t>> Distinct(int num_states,
+                                               int num_threads) const {
+    assert(Enough(num_states));
+    const int64_t max_examined = MaxCandidates(num_states);
+    Shard shards[kShards];
+    int64_t num_distinct = 0;
+    int64_t examined = 0;
+    while (num_distinct < num_states) {
+      if (examined >= max_examined) return std::nullopt;
+      // Mostly distinct when states are plentiful; otherwise this grows
+      // the batch until enough turn up.
+      const int64_t batch =
+          std::max<int64_t>(1024, 2 * (num_states - num_distinct));
+      ParallelFor(batch, num_threads, [&](int64_t b, int64_t e) {
+        std::vector<uint64_t> words(words_per_state());
+        for (int64_t i = examined + b; i < examined + e; ++i) {
+          Candidate(i, words.data());
+          const Fingerprint fp = FingerprintOf(words);
+          Shard& shard = shards[fp.first % kShards];
+          std::lock_guard<std::mutex> lock(shard.mu);
+          // Keep the first candidate with each fingerprint.
+          const auto [it, inserted] = shard.first.try_emplace(fp, i);
+          if (!inserted) it->second = std::min(it->second, i);
+        }
+      });
+      examined += batch;
+      num_distinct = 0;
+      for (const Shard& shard : shards) num_distinct += shard.first.size();
+    }
+    std::vector<int64_t> indices;
+    indices.reserve(num_distinct);
+    for (const Shard& shard : shards) {
+      for (const auto& [fp, i] : shard.first) indices.push_back(i);
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.resize(num_states);
+    return indices;
+  }
+
+  // 'num_states' distinct states, as consecutive rows of
+  // words_per_state() words, or nullopt as for Distinct().
+  std::optional<std::vector<uint64_t>> Generate(int num_states,
+                                                int num_threads) const {
+    const auto indices = Distinct(num_states, num_threads);
+    if (!indices) return std::nullopt;
+    std::vector<uint64_t> words(int64_t(num_states) * words_per_state());
+    ParallelFor(num_states, num_threads, [&](int64_t b, int64_t e) {
+      for (int64_t k = b; k < e; ++k) {
+        Candidate((*indices)[k], &words[k * words_per_state()]);
+      }
+    });
+    return words;
+  }
+
+ private:
+  using Fingerprint = std::pair<uint64_t, uint64_t>;
+  static constexpr int kShards = 64;
+
+  struct Shard {
+    std::mutex mu;
+    // Fingerprint -> first candidate index with it.
+    absl::flat_hash_map<Fingerprint, int64_t> first;
+  };
+
+  const int num_vertices_;
+  const int num_live_;
+  const uint64_t seed_;
+
+  // A bound on the candidates Distinct() examines: 8 times the
+  // coupon-collector expectation N (H(N) - H(N - num_states)) for N
+  // states in all, plus a few batches. Exceeding it by chance is far
+  // less likely than a fingerprint collision.
+  int64_t MaxCandidates(int num_states) const {
+    const double log_count = lgamma(num_vertices_ + 1.0) -
+                             lgamma(num_live_ + 1.0) -
+                             lgamma(num_vertices_ - num_live_ + 1.0);
+    const double n = exp(log_count);
+    // Harmonic numbers, to well within the factor of 8 used.
+    auto harmonic = [](double x) {
+      return x < 1 ? 0.0 : log(x) + 0.5772156649 + 1 / (2 * x);
+    };
+    const double expected =
+        n > 1e15 ? num_states : n * (harmonic(n) - harmonic(n - num_states));
+    return int64_t(8 * std::max<double>(expected, num_states)) + (1 << 20);
+  }
+
+  static bool IsSet(const uint64_t* words, int v) {
+    return (words[v >> 6] >> (v & 63)) & 1;
+  }
+
+  // Two independent 64-bit hashes; distinct states collide with
+  // probability about 2^-128.
+  static Fingerprint FingerprintOf(const std::vector<uint64_t>& words) {
+    uint64_t a = 0x243f6a8885a308d3ULL;
+    uint64_t b = 0x13198a2e03707344ULL;
+    for (const uint64_t w : words) {
+      a = SplitMix64(a ^ w) + 0x9e3779b97f4a7c15ULL;
+      b = SplitMix64(b + w) * 0xff51afd7ed558ccdULL;
+    }
+    return {a, b};
+  }
+};
+
+#endif  // STATE_GEN_H_
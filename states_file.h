@@ -0,0 +1,184 @@
+#ifndef STATES_FILE_H_
+#define STATES_FILE_H_
+
+// Files of initial states.
+//
+// The ASCII format has one state per line, one '1' (live) or other
+// character (dead) per vertex. The packed format is a StatesFileHeader
+// followed by num_states rows of words_per_state uint64 words; bit j of a
+// row is vertex j, as in GLife::State, and bits past num_vertices are 0.
+// Packed files are read through mmap and rows are used in place.
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gbinary.h"
+
+struct StatesFileHeader {
+  static constexpr char kMagic[8] = {'G', 'L', 'I', 'F', 'E', 'S', 'T', '1'};
+
+  char magic[8];
+  uint32_t header_size;
+  uint32_t reserved;
+  int64_t num_vertices;
+  int64_t num_states;
+  int64_t words_per_state;
+};
+
+// The states of a file in either format, or generated, by index. Safe
+// to read from several threads at once.
+class StatesFile {
+ public:
+  // Check ok() before use.
+  explicit StatesFile(const std::string& filename) {
+    if (IsPacked(filename)) {
+      OpenPacked(filename);
+    } else {
+      ReadASCII(filename);
+    }
+  }
+
+  // States already in memory, as consecutive rows of GLife::State words,
+  // e.g. from StateGenerator.
+  StatesFile(int num_vertices, std::vector<uint64_t> words)
+      : ok_(true), num_vertices_(num_vertices),
+        words_per_state_((num_vertices + 63) / 64), words_(std::move(words)) {
+    const size_t num_states =
+        words_per_state_ == 0 ? 0 : words_.size() / words_per_state_;
+    assert(num_states <= INT_MAX);
+    num_states_ = num_states;
+    data_ = words_.data();
+  }
+
+  bool ok() const { return ok_; }
+  int num_vertices() const { return num_vertices_; }
+  int num_states() const { return num_states_; }
+  int words_per_state() const { return words_per_state_; }
+
+  // State 'i' as GLife::State words.
+  const uint64_t* State(int i) const {
+    return data_ + int64_t(i) * words_per_state_;
+  }
+
+  static bool IsPacked(const std::string& filename) {
+    char magic[sizeof(StatesFileHeader::kMagic)];
+    std::ifstream ifs(filename, std::ios::binary);
+    return ifs.read(magic, sizeof(magic)) &&
+           memcmp(magic, StatesFileHeader::kMagic, sizeof(magic)) == 0;
+  }
+
+ private:
+  bool ok_ = false;
+  int num_vertices_ = 0;
+  int num_states_ = 0;
+  int words_per_state_ = 0;
+  const uint64_t* data_ = nullptr;
+  // Backs 'data_': the mapped file, or the parsed ASCII states.
+  std::unique_ptr<MappedFile> file_;
+  std::vector<uint64_t> words_;
+
+  void OpenPacked(const std::string& filename) {
+    file_ = std::make_unique<MappedFile>(filename);
+    if (!file_->ok() || file_->size() < sizeof(StatesFileHeader)) return;
+    StatesFileHeader h;
+    memcpy(&h, file_->data(), sizeof(h));
+    // Counts are ints here, and the rows must fit in the file; divide
+    // rather than multiply so that a crafted header cannot overflow.
+    if (h.header_size != sizeof(h) || h.num_vertices < 0 ||
+        h.num_vertices > INT_MAX || h.num_states < 0 ||
+        h.num_states > INT_MAX ||
+        h.words_per_state != (h.num_vertices + 63) / 64 ||
+        (h.words_per_state > 0 &&
+         uint64_t(h.num_states) >
+             (file_->size() - sizeof(h)) / 8 / h.words_per_state)) {
+      return;
+    }
+    num_vertices_ = h.num_vertices;
+    num_states_ = h.num_states;
+    words_per_state_ = h.words_per_state;
+    data_ = reinterpret_cast<const uint64_t*>(file_->data() + sizeof(h));
+    ok_ = true;
+  }
+
+  void ReadASCII(const std::string& filename) {
+    std::ifstream ifs(filename);
+    if (!ifs) return;
+    std::string state;
+    for (int i = 0; ifs >> state; ++i) {
+      if (i == INT_MAX) return;
+      if (i == 0) {
+        num_vertices_ = state.size();
+        words_per_state_ = (num_vertices_ + 63) / 64;
+      } else if (state.size() != num_vertices_) {
+        return;
+      }
+      words_.resize(words_.size() + words_per_state_);
+      uint64_t* row = &words_[words_.size() - words_per_state_];
+      for (int j = 0; j < num_vertices_; ++j) {
+        if (state[j] == '1') row[j >> 6] |= uint64_t{1} << (j & 63);
+      }
+      num_states_ += 1;
+    }
+    data_ = words_.data();
+    ok_ = true;
+  }
+};
+
+// Writes a packed states file.
+class StatesFileWriter {
+ public:
+  StatesFileWriter(const std::string& filename, int num_vertices)
+      : ofs_(filename, std::ios::binary) {
+    memcpy(header_.magic, StatesFileHeader::kMagic, sizeof(header_.magic));
+    header_.header_size = sizeof(header_);
+    header_.num_vertices = num_vertices;
+    header_.words_per_state = (num_vertices + 63) / 64;
+    row_.resize(header_.words_per_state);
+    // Rewritten with the final count by Close().
+    ofs_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  }
+
+  ~StatesFileWriter() { Close(); }
+
+  // Add a state given as '1' for each live vertex.
+  void Add(const std::string& state) {
+    std::fill(row_.begin(), row_.end(), 0);
+    for (int j = 0; j < header_.num_vertices; ++j) {
+      if (state[j] == '1') row_[j >> 6] |= uint64_t{1} << (j & 63);
+    }
+    Add(row_.data());
+  }
+
+  // Add a state given as words_per_state words.
+  void Add(const uint64_t* words) {
+    ofs_.write(reinterpret_cast<const char*>(words),
+               8 * header_.words_per_state);
+    header_.num_states += 1;
+  }
+
+  // Returns false on I/O errors.
+  bool Close() {
+    if (!ofs_.is_open()) return ok_;
+    ofs_.seekp(0);
+    ofs_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    ofs_.close();
+    ok_ = !ofs_.fail();
+    return ok_;
+  }
+
+ private:
+  std::ofstream ofs_;
+  StatesFileHeader header_ = {};
+  std::vector<uint64_t> row_;
+  bool ok_ = false;
+};
+
+#endif  // STATES_FILE_H_
@@ -0,0 +1,325 @@
+// Parameter sweep
+// Runs every combination of rule, graph perturbation, states file and
+// repetition listed in a grid file in one process: the graph is parsed
+// and each states file read once, and all simulations share one pool
+// of threads. Each combination gets its own results directory, laid out
+// like those of shannon2.
+//
+// Usage: ./sweep [flags] graph grid-file
+//
+// The grid file has one directive per line; '#' starts a comment.
+//   rule life                 one line per rule, see ParseRule()
+//   rule B3/S23
+//   perturb none              unmodified graph
+//   perturb rewire 2 4 8      one point per count; also remove, add
+//   states 30x30_states_1.txt 30x30_states_2.txt
+//   repetitions 5             tries of each random perturbation
+// Without rule or perturb lines the sweep uses "life" and "none".
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "glife.h"
+#include "profile.h"
+#include "rules.h"
+#include "simulate.h"
+#include "states_file.h"
+#include "work_pool.h"
+
+ABSL_FLAG(bool, verbose, false, "Be verbose");
+ABSL_FLAG(bool, count_live, false, "Count live cells in each generation");
+ABSL_FLAG(int, num_threads, std::thread::hardware_concurrency(),
+          "Number of threads to use");
+ABSL_FLAG(int, max_steps, 4000, "Max number of simulations to run");
+ABSL_FLAG(bool, brent, false,
+          "Detect cycles with Brent's algorithm in O(vertices) memory; "
+          "costs up to about twice the steps of the default, e.g. "
+          "2 * --max_steps for a state that does not cycle in time");
+ABSL_FLAG(bool, multi_trial, false,
+          "Advance 64 states at a time per thread in bit-sliced lanes");
+ABSL_FLAG(bool, incremental, false,
+          "Only re-evaluate vertices next to those that changed last step");
+ABSL_FLAG(bool, graph_cache, true,
+          "Load JSON graphs through a binary cache file beside them, "
+          "creating it if needed");
+ABSL_FLAG(std::string, reorder, "",
+          "Renumber the vertices of each perturbed graph for memory "
+          "locality: bfs, rcm or hilbert; outputs are unaffected");
+ABSL_FLAG(uint64_t, edit_seed, 0, "Seed for perturbations; 0 for random");
+ABSL_FLAG(bool, log_edits, false, "Print each edit of the graph on stderr");
+ABSL_FLAG(std::string, output_dir, "", "Output directory");
+
+void usage(const char *argv0)
+{
+  std::cerr << "Usage: " << argv0 << " graph grid-file" << std::endl;
+  exit(1);
+}
+
+struct Perturbation {
+  // "none", "rewire", "remove" or "add".
+  std::string kind = "none";
+  int count = 0;
+
+  std::string Name() const {
+    return kind == "none" ? kind : absl::StrCat(kind, "_", count);
+  }
+
+  // False if the graph allows fewer rewirings than 'count'.
+  bool Apply(GLife* graph) const {
+    if (kind == "rewire") return graph->ReWire(count) >= count;
+    if (kind == "remove") graph->RemoveEdges(count);
+    if (kind == "add") graph->AddEdges(count);
+    return true;
+  }
+};
+
+struct Grid {
+  std::vector<std::string> rules;
+  std::vector<Perturbation> perturbations;
+  std::vector<std::string> states_files;
+  int repetitions = 1;
+};
+
+void GridError(const std::string& filename, int line, const std::string& what)
+{
+  std::cerr << filename << ":" << line << ": " << what << std::endl;
+  exit(1);
+}
+
+Grid ReadGrid(const std::string& filename)
+{
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    std::cerr << "Error: " << filename << " does not exist." << std::endl;
+    exit(1);
+  }
+  Grid grid;
+  std::string line;
+  for (int n = 1; std::getline(ifs, line); ++n) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream iss(line);
+    std::string directive;
+    if (!(iss >> directive)) continue;
+    std::string rest;
+    std::getline(iss, rest);
+    rest = std::string(absl::StripAsciiWhitespace(rest));
+    std::istringstream args(rest);
+    if (directive == "rule") {
+      RuleFn fn;
+      if (!ParseRule(rest, &fn)) GridError(filename, n, "bad rule: " + rest);
+      grid.rules.push_back(rest);
+    } else if (directive == "perturb") {
+      Perturbation p;
+      args >> p.kind;
+      if (p.kind == "none") {
+        grid.perturbations.push_back(p);
+      } else if (p.kind == "rewire" || p.kind == "remove" || p.kind == "add") {
+        while (args >> p.count) grid.perturbations.push_back(p);
+      } else {
+        GridError(filename, n, "bad perturbation: " + p.kind);
+      }
+      if (!args.eof()) GridError(filename, n, "bad count");
+    } else if (directive == "states") {
+      for (std::string f; args >> f;) grid.states_files.push_back(f);
+    } else if (directive == "repetitions") {
+      if (!(args >> grid.repetitions) || grid.repetitions < 1) {
+        GridError(filename, n, "bad repetitions");
+      }
+    } else {
+      GridError(filename, n, "unknown directive " + directive);
+    }
+  }
+  if (grid.rules.empty()) grid.rules.push_back("life");
+  if (grid.perturbations.empty()) grid.perturbations.emplace_back();
+  if (grid.states_files.empty()) GridError(filename, 0, "no states files");
+  return grid;
+}
+
+void MakeDir(const std::string& dir)
+{
+  if (0 != mkdir(dir.c_str(), 0777) && errno != EEXIST) {
+    std::cerr << "mkdir(" << dir << "): " << strerror(errno) << std::endl;
+    exit(1);
+  }
+}
+
+// One combination of the grid.
+struct Point {
+  std::string outd;
+  // The perturbed graph with the rule set.
+  const GLife* graph;
+  const StatesFile* states;
+  std::vector<SimResult> results;
+  // States not yet simulated; whoever finishes the last one saves.
+  std::atomic<int> remaining;
+};
+
+int main(int argc, char *argv[])
+{
+  const auto args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 3) usage(argv[0]);
+  const std::string graph_filename = args[1];
+  const Grid grid = ReadGrid(args[2]);
+
+  const bool verbose = absl::GetFlag(FLAGS_verbose);
+  const int num_threads = std::max(1, absl::GetFlag(FLAGS_num_threads));
+  const bool multi_trial = absl::GetFlag(FLAGS_multi_trial);
+  SimOptions options;
+  options.max_steps = absl::GetFlag(FLAGS_max_steps);
+  options.count_live = absl::GetFlag(FLAGS_count_live);
+  options.brent = absl::GetFlag(FLAGS_brent);
+  if (multi_trial && options.count_live) {
+    std::cerr << argv[0] << ": --multi_trial does not support --count_live"
+              << std::endl;
+    exit(1);
+  }
+  const std::string reorder = absl::GetFlag(FLAGS_reorder);
+  VertexOrder order = VertexOrder::kBFS;
+  if (!reorder.empty() && !ParseVertexOrder(reorder, &order)) {
+    std::cerr << argv[0] << ": unknown --reorder " << reorder << std::endl;
+    exit(1);
+  }
+
+  GLife::SetBinaryCache(absl::GetFlag(FLAGS_graph_cache));
+  if (absl::GetFlag(FLAGS_edit_seed) != 0) {
+    SeedThreadRng(absl::GetFlag(FLAGS_edit_seed));
+  }
+  if (absl::GetFlag(FLAGS_log_edits)) GLife::SetEditLog(&std::cerr);
+  const GLife zygote(graph_filename);
+  std::vector<std::unique_ptr<StatesFile>> states;
+  for (const auto& f : grid.states_files) {
+    states.push_back(std::make_unique<StatesFile>(f));
+    if (!states.back()->ok() ||
+        (states.back()->num_states() > 0 &&
+         states.back()->num_vertices() != zygote.NumVertices())) {
+      std::cerr << argv[0] << ": " << f << " is not a states file for "
+                << graph_filename << std::endl;
+      exit(1);
+    }
+  }
+
+  std::string outd = absl::GetFlag(FLAGS_output_dir);
+  if (outd.empty()) {
+    outd = absl::StrCat("sweep___", time(NULL));
+  }
+  MakeDir(outd);
+
+  // Perturb on this thread, before simulating, so that --edit_seed gives
+  // the same graphs on every run.
+  std::vector<std::unique_ptr<GLife>> graphs;
+  std::vector<std::unique_ptr<Point>> points;
+  for (const auto& perturbation : grid.perturbations) {
+    const int tries = perturbation.kind == "none" ? 1 : grid.repetitions;
+    for (int t = 1; t <= tries; ++t) {
+      GLife perturbed(zygote);
+      if (!perturbation.Apply(&perturbed)) {
+        std::cerr << argv[0] << ": found no valid swap for all of "
+                  << perturbation.Name() << std::endl;
+        exit(1);
+      }
+      if (!reorder.empty() && !perturbed.Reorder(order)) {
+        std::cerr << argv[0] << ": --reorder " << reorder
+                  << " needs vertices named i_j" << std::endl;
+        exit(1);
+      }
+      std::string name = perturbation.Name();
+      if (tries > 1) absl::StrAppend(&name, "__try", t);
+      for (const auto& rule : grid.rules) {
+        RuleFn fn;
+        ParseRule(rule, &fn);
+        graphs.push_back(std::make_unique<GLife>(perturbed));
+        graphs.back()->SetNewStateFn(fn);
+        graphs.back()->SetIncremental(absl::GetFlag(FLAGS_incremental));
+        for (int f = 0; f < states.size(); ++f) {
+          auto point = std::make_unique<Point>();
+          const std::string states_name =
+              grid.states_files[f].substr(grid.states_files[f].rfind('/') + 1);
+          point->outd = absl::StrCat(
+              outd, "/",
+              absl::StrReplaceAll(absl::StrCat(rule, "__", name, "__",
+                                               states_name),
+                                  {{" ", "_"}, {"/", "_"}}));
+          point->graph = graphs.back().get();
+          point->states = states[f].get();
+          point->results.resize(states[f]->num_states());
+          point->remaining = states[f]->num_states();
+          MakeDir(point->outd);
+          std::ofstream ofs(point->outd + "/point.txt");
+          ofs << "graph " << graph_filename << "\nrule " << rule
+              << "\nperturb " << perturbation.kind << " "
+              << perturbation.count << "\ntry " << t << "\nstates "
+              << grid.states_files[f] << std::endl;
+          if (perturbation.kind != "none") {
+            point->graph->DumpToJSON(point->outd + "/graph.json");
+          }
+          if (point->results.empty()) SaveResults(point->outd, {});
+          points.push_back(std::move(point));
+        }
+      }
+    }
+  }
+  if (verbose) {
+    std::cerr << points.size() << " grid points" << std::endl;
+  }
+
+  // Every point's states in chunks, all through one pool. A multi-trial
+  // chunk fills the 64 lanes of a GLifeMulti a few times over.
+  const int chunk = multi_trial ? 4 * GLifeMulti::kLanes : 16;
+  const auto start = std::chrono::steady_clock::now();
+  std::atomic<int> num_saved = 0;
+  {
+    WorkStealingPool pool(num_threads);
+    for (const auto& p : points) {
+      Point* point = p.get();
+      const int num_states = point->states->num_states();
+      for (int begin = 0; begin < num_states; begin += chunk) {
+        const int end = std::min(begin + chunk, num_states);
+        pool.WaitUntilAtMost(4 * num_threads);
+        pool.Submit([point, begin, end, multi_trial, &options, &num_saved,
+                     verbose, start]() {
+          const StatesFile& states = *point->states;
+          if (multi_trial) {
+            int i = begin;
+            RunMultiTrial(*point->graph, options.max_steps,
+                          [&](const uint64_t** state) -> SimResult* {
+                            if (i == end) return nullptr;
+                            *state = states.State(i);
+                            return &point->results[i++];
+                          });
+          } else {
+            GLife glife(*point->graph);
+            for (int i = begin; i < end; ++i) {
+              glife.SetState(states.State(i));
+              point->results[i] = Simulate(glife, options);
+            }
+          }
+          if ((point->remaining -= end - begin) > 0) return;
+          SaveResults(point->outd, point->results);
+          const int saved = ++num_saved;
+          if (verbose) {
+            const std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            std::cerr << saved << " points done in " << elapsed.count()
+                      << "s: " << point->outd << std::endl;
+          }
+        });
+      }
+    }
+    pool.Wait();
+  }
+  profile::WriteProfile(outd + "/profile.json");
+  return 0;
+}
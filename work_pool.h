@@ -0,0 +1,240 @@
+#ifndef WORK_POOL_H_
+#define WORK_POOL_H_
+
+// A fixed set of worker threads with one task deque each. Tasks are
+// dealt round robin; a worker takes from the front of its own deque and,
+// when that is empty, steals from the back of another worker's, so one
+// long task never leaves the other threads idle.
+
+#include <assert.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class WorkStealingPool {
+ public:
+  explicit WorkStealingPool(int num_threads) {
+    assert(num_threads > 0);
+    for (int i = 0; i < num_threads; ++i) {
+      workers_.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this, i]() { Run(i); });
+    }
+  }
+
+  // Finishes all submitted tasks.
+  ~WorkStealingPool() {
+    Wait();
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : threads_) t.join();
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  int num_threads() const { return threads_.size(); }
+
+  void Submit(std::function<void()> task) {
+    Worker& w = *workers_[next_worker_];
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+    {
+      std::lock_guard<std::mutex> lock(w.mu);
+      w.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      queued_ += 1;
+      outstanding_ += 1;
+    }
+    work_cv_.notify_one();
+  }
+
+  // Block until at most 'n' submitted tasks are unfinished.
+  void WaitUntilAtMost(int n) {
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [this, n]() { return outstanding_ <= n; });
+  }
+
+  // Block until all submitted tasks are finished.
+  void Wait() { WaitUntilAtMost(0); }
+
+ private:
+  struct Worker {
+    std::mutex mu;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  // Only touched by the submitting thread.
+  int next_worker_ = 0;
+
+  std::mutex mu_;
+  // Signalled when a task is queued, or on shutdown.
+  std::condition_variable work_cv_;
+  // Signalled when a task finishes.
+  std::condition_variable done_cv_;
+  // Tasks sitting in some deque.
+  int queued_ = 0;
+  // Tasks submitted and not yet finished.
+  int outstanding_ = 0;
+  bool stop_ = false;
+
+  // Take a task from worker 'i', or steal one.
+  bool Take(int i, std::function<void()>* task) {
+    const int n = workers_.size();
+    for (int k = 0; k < n; ++k) {
+      Worker& w = *workers_[(i + k) % n];
+      std::lock_guard<std::mutex> lock(w.mu);
+      if (w.tasks.empty()) continue;
+      if (k == 0) {
+        *task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+      } else {
+        *task = std::move(w.tasks.back());
+        w.tasks.pop_back();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void Run(int i) {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        work_cv_.wait(lock, [this]() { return queued_ > 0 || stop_; });
+        if (queued_ == 0) return;  // stop_
+        queued_ -= 1;
+      }
+      // We reserved a task above, so one is in some deque.
+      std::function<void()> task;
+      while (!Take(i, &task)) {
+      }
+      task();
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        outstanding_ -= 1;
+      }
+      done_cv_.notify_all();
+    }
+  }
+};
+
+// A fixed set of threads that run one function together, each on its
+// own part of the work, for parallelism inside a single simulation. The
+// calling thread takes part 0, so a team of n starts n - 1 threads.
+class ParallelTeam {
+ public:
+  explicit ParallelTeam(int num_threads) {
+    assert(num_threads > 0);
+    for (int part = 1; part < num_threads; ++part) {
+      threads_.emplace_back([this, part]() { Loop(part); });
+    }
+  }
+
+  ~ParallelTeam() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+      generation_ += 1;
+    }
+    start_cv_.notify_all();
+    for (auto& t : threads_) t.join();
+  }
+
+  ParallelTeam(const ParallelTeam&) = delete;
+  ParallelTeam& operator=(const ParallelTeam&) = delete;
+
+  int num_threads() const { return threads_.size() + 1; }
+
+  // Run fn(part) for every part in [0, num_threads()) at once, and return
+  // when all are done.
+  void Run(const std::function<void(int)>& fn) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      fn_ = &fn;
+      pending_ = threads_.size();
+      generation_ += 1;
+    }
+    start_cv_.notify_all();
+    fn(0);
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+  // Part 'part' of [0, size) split evenly.
+  std::pair<size_t, size_t> Range(size_t size, int part) const {
+    const size_t n = num_threads();
+    return {size * part / n, size * (part + 1) / n};
+  }
+
+ private:
+  std::vector<std::thread> threads_;
+  std::mutex mu_;
+  // Signalled when Run() starts a generation, or on shutdown.
+  std::condition_variable start_cv_;
+  // Signalled when the last thread of a generation finishes.
+  std::condition_variable done_cv_;
+  const std::function<void(int)>* fn_ = nullptr;
+  uint64_t generation_ = 0;
+  // Threads not yet done with the current generation.
+  int pending_ = 0;
+  bool stop_ = false;
+
+  void Loop(int part) {
+    uint64_t seen = 0;
+    while (true) {
+      const std::function<void(int)>* fn;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        start_cv_.wait(lock, [&]() { return generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+        fn = fn_;
+      }
+      (*fn)(part);
+      std::lock_guard<std::mutex> lock(mu_);
+      if (--pending_ == 0) done_cv_.notify_one();
+    }
+  }
+};
+
+// A ParallelTeam of a set size, started on first use. Teams belong to
+// threads rather than to LazyTeams: every LazyTeam of one size shares
+// the team of the thread it is used on, which lasts as long as that
+// thread. Copies are thus free, e.g. a GLife copied per task or for the
+// hare in FindCycleBrent(), while copies on different threads never
+// share a team.
+class LazyTeam {
+ public:
+  int num_threads() const { return num_threads_; }
+
+  void SetNumThreads(int num_threads) { num_threads_ = num_threads; }
+
+  // The calling thread's team, or null for a single thread.
+  ParallelTeam* Get() const {
+    if (num_threads_ <= 1) return nullptr;
+    thread_local std::map<int, std::unique_ptr<ParallelTeam>> teams;
+    std::unique_ptr<ParallelTeam>& team = teams[num_threads_];
+    if (!team) team = std::make_unique<ParallelTeam>(num_threads_);
+    return team.get();
+  }
+
+ private:
+  int num_threads_ = 1;
+};
+
+#endif  // WORK_POOL_H_